@@ -21,6 +21,39 @@ function coherseToBuffer(input) {
   return Buffer.isBuffer(input) ? input : Buffer.from(input);
 }
 
+// FNV-1a, seeded through the offset basis - must match WWWData::hashUri in the generated header
+function hashUri(uri, seed) {
+  let hash = seed >>> 0;
+  for (const b of Buffer.from(uri)) {
+    hash ^= b;
+    hash = Math.imul(hash, 16777619) >>> 0;
+  }
+  return hash;
+}
+
+// Finds a seed which hashes every uri to its own slot, growing the table until one exists. Where a uri is listed more
+// than once only the first is given a slot, as only the first would have been routed to.
+// The slot count is kept odd, never a power of two, as the low bits of an FNV hash depend only on the low bits of the
+// seed.
+function findPerfectHash(uris, maxSeeds = 10000) {
+  const indexes = uris.map((uri, index) => index).filter((index) => uris.indexOf(uris[index]) === index);
+  for (let slotCount = indexes.length * 2 + 1; ; slotCount += 2) {
+    for (let seed = 2166136261; seed < 2166136261 + maxSeeds; seed++) {
+      const slots = new Array(slotCount).fill(0xFFFF);
+      if (indexes.every((index) => {
+        const slot = hashUri(uris[index], seed) % slotCount;
+        if (slots[slot] !== 0xFFFF) {
+          return false;
+        }
+        slots[slot] = index;
+        return true;
+      })) {
+        return { seed, slots };
+      }
+    }
+  }
+}
+
 function cleanAndOpen(path) {
   if (existsSync(path)) {
     unlinkSync(path);
@@ -88,6 +121,35 @@ class ProgmemGenerator {
             });
           };
 
+          const generateAssetTable = () => {
+            const { seed, slots } = findPerfectHash(fileInfo.map((file) => file.uri));
+            const strings = fileInfo.map((file, index) =>
+              `const char ESP_REACT_URI_${index}[] PROGMEM = "${file.uri}";\n` +
+              `const char ESP_REACT_TYPE_${index}[] PROGMEM = "${file.mimeType}";\n`
+            ).join('');
+            return `${strings}
+typedef struct WWWAsset {
+${indent}const char* uri;
+${indent}const char* contentType;
+${indent}const uint8_t* content;
+${indent}size_t len;
+} WWWAsset_t;
+
+const WWWAsset_t ESP_REACT_ASSETS[] PROGMEM = {
+${fileInfo.map((file, index) => `${indent}{ESP_REACT_URI_${index}, ESP_REACT_TYPE_${index}, ${file.variable}, ${file.size}},`).join('\n')}
+};
+
+#define ESP_REACT_ASSET_HASH_SEED ${seed}U
+#define ESP_REACT_ASSET_SLOT_COUNT ${slots.length}
+
+// Index into ESP_REACT_ASSETS for each hash slot, or 0xFFFF where no uri hashes to the slot
+const uint16_t ESP_REACT_ASSET_SLOTS[] PROGMEM = {
+${indent}${slots.map((slot) => "0x" + ("0000" + slot.toString(16).toUpperCase()).substr(-4)).join(', ')}
+};
+
+`;
+          };
+
           const generateWWWClass = () => {
             // eslint-disable-next-line max-len
             return `typedef std::function<void(const String& uri, const String& contentType, const uint8_t * content, size_t len)> RouteRegistrationHandler;
@@ -97,16 +159,41 @@ ${indent}public:
 ${indent.repeat(2)}static void registerRoutes(RouteRegistrationHandler handler) {
 ${fileInfo.map((file) => `${indent.repeat(3)}handler("${file.uri}", "${file.mimeType}", ${file.variable}, ${file.size});`).join('\n')}
 ${indent.repeat(2)}}
+
+${indent.repeat(2)}// Looks up the asset served at the uri with a single probe of the perfect hash table
+${indent.repeat(2)}static bool findAsset(const char* uri, WWWAsset_t& asset) {
+${indent.repeat(3)}uint16_t index = pgm_read_word(&ESP_REACT_ASSET_SLOTS[hashUri(uri) % ESP_REACT_ASSET_SLOT_COUNT]);
+${indent.repeat(3)}if (index == 0xFFFF) {
+${indent.repeat(4)}return false;
+${indent.repeat(3)}}
+${indent.repeat(3)}memcpy_P(&asset, &ESP_REACT_ASSETS[index], sizeof(WWWAsset_t));
+${indent.repeat(3)}return strcmp_P(uri, asset.uri) == 0;
+${indent.repeat(2)}}
+
+${indent}private:
+${indent.repeat(2)}static uint32_t hashUri(const char* uri) {
+${indent.repeat(3)}uint32_t hash = ESP_REACT_ASSET_HASH_SEED;
+${indent.repeat(3)}for (; *uri; uri++) {
+${indent.repeat(4)}hash ^= (uint8_t)*uri;
+${indent.repeat(4)}hash *= 16777619U;
+${indent.repeat(3)}}
+${indent.repeat(3)}return hash;
+${indent.repeat(2)}}
 };
 `;
           };
 
+          const writeAssetTable = () => {
+            writeStream.write(generateAssetTable());
+          };
+
           const writeWWWClass = () => {
             writeStream.write(generateWWWClass());
           };
 
           writeIncludes();
           writeFiles();
+          writeAssetTable();
           writeWWWClass();
 
           writeStream.on('finish', () => {
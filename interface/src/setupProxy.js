@@ -8,6 +8,11 @@ module.exports = function (app) {
       target
     })
   );
+  app.use(
+    createProxyMiddleware('/es', {
+      target
+    })
+  );
   app.use(
     createProxyMiddleware('/ws', {
       target: target.replace(/^http(s?):\/\//, "ws$1://"),
@@ -15,7 +15,13 @@ interface WebSocketPayloadMessage<D> {
   payload: D;
 }
 
-export type WebSocketMessage<D> = WebSocketIdMessage | WebSocketPayloadMessage<D>;
+interface WebSocketDeltaMessage<D> {
+  type: "delta";
+  origin_id: string;
+  payload: Partial<D>;
+}
+
+export type WebSocketMessage<D> = WebSocketIdMessage | WebSocketPayloadMessage<D> | WebSocketDeltaMessage<D>;
 
 export const useWs = <D>(wsUrl: string, wsThrottle: number = 100) => {
 
@@ -40,6 +46,11 @@ export const useWs = <D>(wsUrl: string, wsThrottle: number = 100) => {
             setData((existingData) => (clientId.current === message.origin_id && existingData) || message.payload);
           }
           break;
+        case "delta":
+          if (clientId.current) {
+            setData((existingData) => existingData && { ...existingData, ...message.payload });
+          }
+          break;
       }
     }
   }, []);
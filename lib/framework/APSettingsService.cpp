@@ -1,8 +1,8 @@
 #include <APSettingsService.h>
 
 APSettingsService::APSettingsService(AsyncWebServer* server, FS* fs, SecurityManager* securityManager) :
-    _httpEndpoint(APSettings::read, APSettings::update, this, server, AP_SETTINGS_SERVICE_PATH, securityManager),
-    _fsPersistence(APSettings::read, APSettings::update, this, fs, AP_SETTINGS_FILE),
+    _httpEndpoint(APSettingsReader(), APSettingsUpdater(), this, server, AP_SETTINGS_SERVICE_PATH, securityManager),
+    _fsPersistence(APSettingsReader(), APSettingsUpdater(), this, fs, AP_SETTINGS_FILE),
     _dnsServer(nullptr),
     _lastManaged(0),
     _reconfigureAp(false) {
@@ -117,6 +117,9 @@ class APSettings {
   }
 };
 
+typedef StaticJsonStateReader<APSettings, APSettings::read> APSettingsReader;
+typedef StaticJsonStateUpdater<APSettings, APSettings::update> APSettingsUpdater;
+
 class APSettingsService : public StatefulService<APSettings> {
  public:
   APSettingsService(AsyncWebServer* server, FS* fs, SecurityManager* securityManager);
@@ -126,8 +129,8 @@ class APSettingsService : public StatefulService<APSettings> {
   APNetworkStatus getAPNetworkStatus();
 
  private:
-  HttpEndpoint<APSettings> _httpEndpoint;
-  FSPersistence<APSettings> _fsPersistence;
+  HttpEndpoint<APSettings, APSettingsReader, APSettingsUpdater> _httpEndpoint;
+  FSPersistence<APSettings, APSettingsReader, APSettingsUpdater> _fsPersistence;
 
   // for the captive portal
   DNSServer* _dnsServer;
@@ -1,7 +1,10 @@
 #include <APStatus.h>
 
 APStatus::APStatus(AsyncWebServer* server, SecurityManager* securityManager, APSettingsService* apSettingsService) :
-    _apSettingsService(apSettingsService) {
+    _apSettingsService(apSettingsService),
+    _statusCache(std::bind(&APStatus::readStatus, this, std::placeholders::_1),
+                 MAX_AP_STATUS_SIZE,
+                 AP_STATUS_CACHE_TTL) {
   server->on(AP_STATUS_SERVICE_PATH,
              HTTP_GET,
              securityManager->wrapRequest(std::bind(&APStatus::apStatus, this, std::placeholders::_1),
@@ -9,14 +12,12 @@ APStatus::APStatus(AsyncWebServer* server, SecurityManager* securityManager, APS
 }
 
 void APStatus::apStatus(AsyncWebServerRequest* request) {
-  AsyncJsonResponse* response = new AsyncJsonResponse(false, MAX_AP_STATUS_SIZE);
-  JsonObject root = response->getRoot();
+  request->send(200, JSON_MIMETYPE, _statusCache.serialize());
+}
 
+void APStatus::readStatus(JsonObject& root) {
   root["status"] = _apSettingsService->getAPNetworkStatus();
   root["ip_address"] = WiFi.softAPIP().toString();
   root["mac_address"] = WiFi.softAPmacAddress();
   root["station_num"] = WiFi.softAPgetStationNum();
-
-  response->setLength();
-  request->send(response);
 }
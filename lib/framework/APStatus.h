@@ -12,20 +12,31 @@
 #include <ArduinoJson.h>
 #include <AsyncJson.h>
 #include <ESPAsyncWebServer.h>
+#include <StatusCache.h>
 #include <IPAddress.h>
 #include <SecurityManager.h>
 #include <APSettingsService.h>
 
 #define MAX_AP_STATUS_SIZE 1024
+#ifndef AP_STATUS_CACHE_TTL
+#define AP_STATUS_CACHE_TTL DEFAULT_STATUS_CACHE_TTL
+#endif
 #define AP_STATUS_SERVICE_PATH "/rest/apStatus"
 
 class APStatus {
  public:
   APStatus(AsyncWebServer* server, SecurityManager* securityManager, APSettingsService* apSettingsService);
 
+  String serializeStatus() {
+    return _statusCache.serialize();
+  }
+
  private:
   APSettingsService* _apSettingsService;
+  StatusCache _statusCache;
+
   void apStatus(AsyncWebServerRequest* request);
+  void readStatus(JsonObject& root);
 };
 
 #endif  // end APStatus_h
@@ -0,0 +1,77 @@
+#include <BatchService.h>
+
+#include <algorithm>
+#include <memory>
+
+BatchService::BatchService(AsyncWebServer* server, SecurityManager* securityManager) :
+    _securityManager(securityManager) {
+  server->on(BATCH_SERVICE_PATH, HTTP_GET, std::bind(&BatchService::batch, this, std::placeholders::_1));
+}
+
+void BatchService::addSource(const String& path,
+                             BatchSourceSerializer serializer,
+                             AuthenticationPredicate authenticationPredicate) {
+  _sources.push_back({path, serializer, authenticationPredicate});
+}
+
+void BatchService::batch(AsyncWebServerRequest* request) {
+  const AsyncWebParameter* pathsParameter = request->getParam(BATCH_PATHS_PARAMETER);
+  if (!pathsParameter) {
+    request->send(400);
+    return;
+  }
+
+  // resolve the requested paths, checking them all against a single authentication of the request
+  Authentication authentication = _securityManager->authenticateRequest(request);
+  std::shared_ptr<std::vector<size_t>> selected = std::make_shared<std::vector<size_t>>();
+  String paths = pathsParameter->value();
+  int start = 0;
+  while (start < (int)paths.length()) {
+    int end = paths.indexOf(',', start);
+    if (end < 0) {
+      end = paths.length();
+    }
+    String path = paths.substring(start, end);
+    start = end + 1;
+    for (size_t i = 0; i < _sources.size(); i++) {
+      if (_sources[i].path == path) {
+        if (!_sources[i].authenticationPredicate(authentication)) {
+          request->send(401);
+          return;
+        }
+        // a path requested twice is sent once, as a repeated key would make the response ambiguous
+        if (std::find(selected->begin(), selected->end(), i) == selected->end()) {
+          selected->push_back(i);
+        }
+        break;
+      }
+    }
+  }
+  if (!RequestGovernor::admit(request)) {
+    return;
+  }
+
+  int i = -1;
+  request->send(ChunkedJsonResponse::begin(request, [this, selected, i](String& fragment) mutable {
+    int count = selected->size();
+    if (i > count) {
+      return false;
+    }
+    if (i == -1) {
+      fragment = "{";
+    } else if (i == count) {
+      fragment = "}";
+    } else {
+      if (i > 0) {
+        fragment = ",";
+      }
+      BatchSource_t& source = _sources[(*selected)[i]];
+      fragment += "\"";
+      fragment += source.path;
+      fragment += "\":";
+      fragment += source.serializer();
+    }
+    i++;
+    return true;
+  }));
+}
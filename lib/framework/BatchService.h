@@ -0,0 +1,47 @@
+#ifndef BatchService_h
+#define BatchService_h
+
+#include <ArduinoJson.h>
+#include <AsyncJson.h>
+#include <ESPAsyncWebServer.h>
+#include <ChunkedJsonResponse.h>
+#include <SecurityManager.h>
+
+#include <vector>
+
+#define BATCH_SERVICE_PATH "/rest/batch"
+#define BATCH_PATHS_PARAMETER "paths"
+
+// Returns the serialized body of a source, typically from the source's StatusCache
+typedef std::function<String()> BatchSourceSerializer;
+
+/**
+ * Serves several read-only endpoints in a single request, e.g. GET /rest/batch?paths=/rest/wifiStatus,/rest/ntpStatus
+ * responds with {"/rest/wifiStatus":{...},"/rest/ntpStatus":{...}}. The request is authenticated once for all of the
+ * paths and answered with 401 if any of them is forbidden. Paths which are not registered as sources are left out.
+ *
+ * Each source is serialized only as the connection has room for it, so the response is streamed with at most one
+ * source's body in memory.
+ */
+class BatchService {
+ public:
+  BatchService(AsyncWebServer* server, SecurityManager* securityManager);
+
+  void addSource(const String& path,
+                 BatchSourceSerializer serializer,
+                 AuthenticationPredicate authenticationPredicate = AuthenticationPredicates::IS_AUTHENTICATED);
+
+ private:
+  typedef struct BatchSource {
+    String path;
+    BatchSourceSerializer serializer;
+    AuthenticationPredicate authenticationPredicate;
+  } BatchSource_t;
+
+  SecurityManager* _securityManager;
+  std::vector<BatchSource_t> _sources;
+
+  void batch(AsyncWebServerRequest* request);
+};
+
+#endif  // end BatchService_h
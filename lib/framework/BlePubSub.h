@@ -29,10 +29,10 @@ class BleConnector {
   }
 };
 
-template <class T>
+template <class T, class StateReader = JsonStateReader<T>>
 class BlePub : virtual public BleConnector<T> {
  public:
-  BlePub(JsonStateReader<T> stateReader,
+  BlePub(StateReader stateReader,
          StatefulService<T>* statefulService,
          BLEServer* bleServer,
          BLECharacteristic* characteristic = nullptr,
@@ -41,48 +41,66 @@ class BlePub : virtual public BleConnector<T> {
       _stateReader(stateReader),
       _characteristic(characteristic) {
     BleConnector<T>::_statefulService->addUpdateHandler(
-        [&](const String& originId) { 
+        [&](const String& originId, state_field_mask_t changedFields) {
           if (originId != BLE_ORIGIN_ID) {
-            notify(); 
+            notify(changedFields);
           }
-        }, 
+        },
         false);
   }
 
+  /**
+   * Enables delta notifications. Once set, changes made by a delta updater notify only the changed fields, which
+   * clients merge into the state they hold. The characteristic value always holds the full state, so a read or a
+   * client subscribing later sees all of it.
+   */
+  void setDeltaReader(JsonStateDeltaReader<T> deltaReader) {
+    _deltaReader = deltaReader;
+  }
+
   void setCharacteristic(BLECharacteristic* characteristic) {
     _characteristic = characteristic;
     if (_characteristic) {
       _characteristic->addDescriptor(new BLE2902());
+      _characteristic->setValue(
+          BleConnector<T>::_statefulService->serialize(_stateReader, BleConnector<T>::_bufferSize).c_str());
     }
   }
 
  protected:
-  void notify() {
-    if (_characteristic && BleConnector<T>::_bleServer->getConnectedCount() > 0) {
-      // Serialize to JSON doc
-      DynamicJsonDocument json(BleConnector<T>::_bufferSize);
-      JsonObject jsonObject = json.to<JsonObject>();
-      BleConnector<T>::_statefulService->read(jsonObject, _stateReader);
-
-      // Serialize to string
-      String payload;
-      serializeJson(json, payload);
-
-      // Notify BLE clients
+  void notify(state_field_mask_t fields = STATE_FIELDS_ALL) {
+    if (!_characteristic) {
+      return;
+    }
+    // the full state, sharing the cached payload, is what the characteristic holds
+    String payload = BleConnector<T>::_statefulService->serialize(_stateReader, BleConnector<T>::_bufferSize);
+    if (BleConnector<T>::_bleServer->getConnectedCount() > 0 && _deltaReader && fields != STATE_FIELDS_ALL) {
+      String delta;
+      std::unique_ptr<DynamicJsonDocument> json = BleConnector<T>::_statefulService->readDocument(
+          [&](T& settings, JsonObject& root) { _deltaReader(settings, root, fields); }, BleConnector<T>::_bufferSize);
+      serializeJson(*json, delta);
+      // notify() sends the current value, which holds the delta only until the full state is restored below
+      _characteristic->setValue(delta.c_str());
+      _characteristic->notify();
       _characteristic->setValue(payload.c_str());
+      return;
+    }
+    _characteristic->setValue(payload.c_str());
+    if (BleConnector<T>::_bleServer->getConnectedCount() > 0) {
       _characteristic->notify();
     }
   }
 
  private:
-  JsonStateReader<T> _stateReader;
+  StateReader _stateReader;
+  JsonStateDeltaReader<T> _deltaReader;
   BLECharacteristic* _characteristic;
 };
 
-template <class T>
+template <class T, class StateUpdater = JsonStateUpdater<T>>
 class BleSub : virtual public BleConnector<T> {
  public:
-  BleSub(JsonStateUpdater<T> stateUpdater,
+  BleSub(StateUpdater stateUpdater,
          StatefulService<T>* statefulService,
          BLEServer* bleServer,
          BLECharacteristic* characteristic = nullptr,
@@ -99,20 +117,30 @@ class BleSub : virtual public BleConnector<T> {
     }
   }
 
+  // Applies incoming writes with a delta updater, so changed fields are tracked for delta notifications
+  void setDeltaUpdater(JsonStateDeltaUpdater<T> deltaUpdater) {
+    _deltaUpdater = deltaUpdater;
+  }
+
  protected:
   void onBleWrite(const String& value) {
     // Parse JSON
-    DynamicJsonDocument json(BleConnector<T>::_bufferSize);
-    DeserializationError error = deserializeJson(json, value);
-
-    if (!error && json.is<JsonObject>()) {
-      JsonObject jsonObject = json.as<JsonObject>();
-      BleConnector<T>::_statefulService->update(jsonObject, _stateUpdater, BLE_ORIGIN_ID);
+    std::unique_ptr<DynamicJsonDocument> json;
+    DeserializationError error = JsonUtils::readJson(json, value.c_str(), value.length(), BleConnector<T>::_bufferSize);
+
+    if (!error && json->is<JsonObject>()) {
+      JsonObject jsonObject = json->as<JsonObject>();
+      if (_deltaUpdater) {
+        BleConnector<T>::_statefulService->update(jsonObject, _deltaUpdater, BLE_ORIGIN_ID);
+      } else {
+        BleConnector<T>::_statefulService->update(jsonObject, _stateUpdater, BLE_ORIGIN_ID);
+      }
     }
   }
 
  private:
-  JsonStateUpdater<T> _stateUpdater;
+  StateUpdater _stateUpdater;
+  JsonStateDeltaUpdater<T> _deltaUpdater;
   BLECharacteristic* _characteristic;
 
   class BleCallbacks : public BLECharacteristicCallbacks {
@@ -131,23 +159,23 @@ class BleSub : virtual public BleConnector<T> {
   };
 };
 
-template <class T>
-class BlePubSub : public BlePub<T>, public BleSub<T> {
+template <class T, class StateReader = JsonStateReader<T>, class StateUpdater = JsonStateUpdater<T>>
+class BlePubSub : public BlePub<T, StateReader>, public BleSub<T, StateUpdater> {
  public:
-  BlePubSub(JsonStateReader<T> stateReader,
-            JsonStateUpdater<T> stateUpdater,
+  BlePubSub(StateReader stateReader,
+            StateUpdater stateUpdater,
             StatefulService<T>* statefulService,
             BLEServer* bleServer,
             BLECharacteristic* characteristic = nullptr,
             size_t bufferSize = DEFAULT_BUFFER_SIZE) :
       BleConnector<T>(statefulService, bleServer, bufferSize),
-      BlePub<T>(stateReader, statefulService, bleServer, characteristic, bufferSize),
-      BleSub<T>(stateUpdater, statefulService, bleServer, characteristic, bufferSize) {
+      BlePub<T, StateReader>(stateReader, statefulService, bleServer, characteristic, bufferSize),
+      BleSub<T, StateUpdater>(stateUpdater, statefulService, bleServer, characteristic, bufferSize) {
   }
 
   void configureCharacteristic(BLECharacteristic* characteristic) {
-    BlePub<T>::setCharacteristic(characteristic);
-    BleSub<T>::setCharacteristic(characteristic);
+    BlePub<T, StateReader>::setCharacteristic(characteristic);
+    BleSub<T, StateUpdater>::setCharacteristic(characteristic);
   }
 };
 
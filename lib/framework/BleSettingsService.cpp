@@ -7,14 +7,14 @@
 BleSettingsService::BleSettingsService(AsyncWebServer* server,
                                        FS* fs,
                                        SecurityManager* securityManager) :
-    _httpEndpoint(BleSettings::read,
-                  BleSettings::update,
+    _httpEndpoint(BleSettingsReader(),
+                  BleSettingsUpdater(),
                   this,
                   server,
                   BLE_SETTINGS_PATH,
                   securityManager,
                   AuthenticationPredicates::IS_AUTHENTICATED),
-    _fsPersistence(BleSettings::read, BleSettings::update, this, fs, BLE_SETTINGS_FILE),
+    _fsPersistence(BleSettingsReader(), BleSettingsUpdater(), this, fs, BLE_SETTINGS_FILE),
     _bleServer(nullptr),
     _onServerStartedCallback(nullptr) {
   addUpdateHandler([&](const String& originId) { onConfigUpdated(); }, false);
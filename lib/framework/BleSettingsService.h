@@ -44,6 +44,9 @@ class BleSettings {
   }
 };
 
+typedef StaticJsonStateReader<BleSettings, BleSettings::read> BleSettingsReader;
+typedef StaticJsonStateUpdater<BleSettings, BleSettings::update> BleSettingsUpdater;
+
 class BleSettingsService : public StatefulService<BleSettings> {
  public:
   BleSettingsService(AsyncWebServer* server, FS* fs, SecurityManager* securityManager);
@@ -59,8 +62,8 @@ class BleSettingsService : public StatefulService<BleSettings> {
   }
 
  private:
-  HttpEndpoint<BleSettings> _httpEndpoint;
-  FSPersistence<BleSettings> _fsPersistence;
+  HttpEndpoint<BleSettings, BleSettingsReader, BleSettingsUpdater> _httpEndpoint;
+  FSPersistence<BleSettings, BleSettingsReader, BleSettingsUpdater> _fsPersistence;
   BLEServer* _bleServer;
   BleServerCallback _onServerStartedCallback;
 
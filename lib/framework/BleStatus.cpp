@@ -7,8 +7,8 @@
 #include <BLEDevice.h>
 
 BleStatus::BleStatus(AsyncWebServer* server, SecurityManager* securityManager, BLEServer* bleServer) :
-    _httpEndpoint(BleStatusData::read,
-                  BleStatusData::update,
+    _httpEndpoint(BleStatusDataReader(),
+                  BleStatusDataUpdater(),
                   this,
                   server,
                   BLE_STATUS_PATH,
@@ -30,13 +30,16 @@ class BleStatusData {
   }
 };
 
+typedef StaticJsonStateReader<BleStatusData, BleStatusData::read> BleStatusDataReader;
+typedef StaticJsonStateUpdater<BleStatusData, BleStatusData::update> BleStatusDataUpdater;
+
 class BleStatus : public StatefulService<BleStatusData> {
  public:
   BleStatus(AsyncWebServer* server, SecurityManager* securityManager, BLEServer* bleServer);
   void updateStatus();
 
  private:
-  HttpEndpoint<BleStatusData> _httpEndpoint;
+  HttpEndpoint<BleStatusData, BleStatusDataReader, BleStatusDataUpdater> _httpEndpoint;
   BLEServer* _bleServer;
 };
 
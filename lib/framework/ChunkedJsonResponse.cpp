@@ -0,0 +1,91 @@
+#include <ChunkedJsonResponse.h>
+
+#include <memory>
+
+typedef struct ChunkedJsonResponseState {
+  JsonFragmentGenerator generator;
+  String fragment;
+  size_t offset;
+  bool done;
+} ChunkedJsonResponseState_t;
+
+AsyncWebServerResponse* ChunkedJsonResponse::begin(AsyncWebServerRequest* request, JsonFragmentGenerator generator) {
+  std::shared_ptr<ChunkedJsonResponseState_t> state = std::make_shared<ChunkedJsonResponseState_t>();
+  state->generator = generator;
+  state->offset = 0;
+  state->done = false;
+  return request->beginChunkedResponse(JSON_MIMETYPE, [state](uint8_t* buffer, size_t maxLen, size_t index) {
+    size_t written = 0;
+    while (written < maxLen) {
+      if (state->offset == state->fragment.length()) {
+        state->fragment = String();
+        state->offset = 0;
+        if (state->done || !state->generator(state->fragment)) {
+          // returning zero bytes ends the response
+          state->done = true;
+          break;
+        }
+        continue;
+      }
+      size_t length = state->fragment.length() - state->offset;
+      if (length > maxLen - written) {
+        length = maxLen - written;
+      }
+      memcpy(buffer + written, state->fragment.c_str() + state->offset, length);
+      state->offset += length;
+      written += length;
+    }
+    return written;
+  });
+}
+
+/**
+ * Receives the whole serialized document and copies out only the bytes from a given offset which fit in the chunk.
+ */
+class JsonChunkWriter : public Print {
+ public:
+  JsonChunkWriter(uint8_t* buffer, size_t from, size_t length) :
+      _buffer(buffer), _from(from), _length(length), _position(0), _written(0) {
+  }
+
+  size_t write(uint8_t c) {
+    return write(&c, 1);
+  }
+
+  size_t write(const uint8_t* data, size_t size) {
+    size_t skipped = _position < _from ? _from - _position : 0;
+    _position += size;
+    if (skipped >= size) {
+      return size;
+    }
+    size_t length = size - skipped;
+    if (length > _length - _written) {
+      length = _length - _written;
+    }
+    memcpy(_buffer + _written, data + skipped, length);
+    _written += length;
+    return size;
+  }
+
+  size_t written() {
+    return _written;
+  }
+
+ private:
+  uint8_t* _buffer;
+  size_t _from;
+  size_t _length;
+  size_t _position;
+  size_t _written;
+};
+
+AsyncWebServerResponse* ChunkedJsonResponse::begin(AsyncWebServerRequest* request,
+                                                   std::unique_ptr<DynamicJsonDocument> document) {
+  std::shared_ptr<DynamicJsonDocument> source(document.release());
+  return request->beginChunkedResponse(JSON_MIMETYPE, [source](uint8_t* buffer, size_t maxLen, size_t index) {
+    // index counts the bytes already sent, returning zero bytes ends the response
+    JsonChunkWriter writer(buffer, index, maxLen);
+    serializeJson(*source, writer);
+    return writer.written();
+  });
+}
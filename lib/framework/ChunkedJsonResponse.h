@@ -0,0 +1,36 @@
+#ifndef ChunkedJsonResponse_h
+#define ChunkedJsonResponse_h
+
+#include <Arduino.h>
+#include <AsyncJson.h>
+#include <ESPAsyncWebServer.h>
+
+#include <functional>
+#include <memory>
+
+// States whose JSON documents need more than this many bytes are streamed by HttpGetEndpoint
+#ifndef CHUNKED_RESPONSE_THRESHOLD
+#define CHUNKED_RESPONSE_THRESHOLD 1024
+#endif
+
+// Sets fragment to the next piece of the response, returning false once there is nothing more to send
+typedef std::function<bool(String& fragment)> JsonFragmentGenerator;
+
+/**
+ * A JSON response sent with chunked transfer encoding, produced one fragment at a time as the connection has room for
+ * it. Only the fragment being sent is held in memory, so peak heap depends on the largest fragment rather than the
+ * size of the whole response.
+ */
+class ChunkedJsonResponse {
+ public:
+  static AsyncWebServerResponse* begin(AsyncWebServerRequest* request, JsonFragmentGenerator generator);
+
+  /**
+   * Streams a document, which is kept until the response ends. Each chunk is filled by serializing the document again
+   * and keeping only the bytes which belong in it, so the serialized payload is never held in memory, at the cost of
+   * one serialization per chunk.
+   */
+  static AsyncWebServerResponse* begin(AsyncWebServerRequest* request, std::unique_ptr<DynamicJsonDocument> document);
+};
+
+#endif  // end ChunkedJsonResponse_h
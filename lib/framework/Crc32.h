@@ -0,0 +1,42 @@
+#ifndef Crc32_h
+#define Crc32_h
+
+#include <Arduino.h>
+
+/**
+ * CRC-32 (IEEE 802.3, as used by zip and PNG), computed a nibble at a time so the lookup table is only 64 bytes.
+ */
+class Crc32 {
+ public:
+  static uint32_t calculate(const uint8_t* data, size_t length) {
+    return update(0, data, length);
+  }
+
+  // Continues a CRC over further data, start with a crc of 0
+  static uint32_t update(uint32_t crc, const uint8_t* data, size_t length) {
+    static const uint32_t table[16] = {0x00000000,
+                                       0x1DB71064,
+                                       0x3B6E20C8,
+                                       0x26D930AC,
+                                       0x76DC4190,
+                                       0x6B6B51F4,
+                                       0x4DB26158,
+                                       0x5005713C,
+                                       0xEDB88320,
+                                       0xF00F9344,
+                                       0xD6D6A3E8,
+                                       0xCB61B38C,
+                                       0x9B64C2B0,
+                                       0x86D3D2D4,
+                                       0xA00AE278,
+                                       0xBDBDF21C};
+    crc = ~crc;
+    for (size_t i = 0; i < length; i++) {
+      crc = table[(crc ^ data[i]) & 0x0F] ^ (crc >> 4);
+      crc = table[(crc ^ (data[i] >> 4)) & 0x0F] ^ (crc >> 4);
+    }
+    return ~crc;
+  }
+};
+
+#endif  // end Crc32_h
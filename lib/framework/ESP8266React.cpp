@@ -1,6 +1,9 @@
 #include <ESP8266React.h>
 
 ESP8266React::ESP8266React(AsyncWebServer* server) :
+#ifdef ENABLE_CONFIG_STORE
+    _configStore(&ESPFS),
+#endif
     _featureService(server),
     _securitySettingsService(server, &ESPFS),
     _wifiSettingsService(server, &ESPFS, &_securitySettingsService),
@@ -32,31 +35,24 @@ ESP8266React::ESP8266React(AsyncWebServer* server) :
 #endif
     _restartService(server, &_securitySettingsService),
     _factoryResetService(server, &ESPFS, &_securitySettingsService),
-    _systemStatus(server, &_securitySettingsService) {
+    _systemStatus(server, &_securitySettingsService),
+    _batchService(server, &_securitySettingsService) {
 #ifdef PROGMEM_WWW
   // Serve static resources from PROGMEM
-  WWWData::registerRoutes(
-      [server, this](const String& uri, const String& contentType, const uint8_t* content, size_t len) {
-        ArRequestHandlerFunction requestHandler = [contentType, content, len](AsyncWebServerRequest* request) {
-          AsyncWebServerResponse* response = request->beginResponse_P(200, contentType, content, len);
-          response->addHeader("Content-Encoding", "gzip");
-          request->send(response);
-        };
-        server->on(uri.c_str(), HTTP_GET, requestHandler);
-        // Serving non matching get requests with "/index.html"
-        // OPTIONS get a straight up 200 response
-        if (uri.equals("/index.html")) {
-          server->onNotFound([requestHandler](AsyncWebServerRequest* request) {
-            if (request->method() == HTTP_GET) {
-              requestHandler(request);
-            } else if (request->method() == HTTP_OPTIONS) {
-              request->send(200);
-            } else {
-              request->send(404);
-            }
-          });
-        }
-      });
+  server->addHandler(&_wwwDataHandler);
+  // Serving non matching get requests with "/index.html"
+  // OPTIONS get a straight up 200 response
+  server->onNotFound([](AsyncWebServerRequest* request) {
+    if (request->method() == HTTP_GET) {
+      if (!WWWDataHandler::sendAsset(request, "/index.html")) {
+        request->send(404);
+      }
+    } else if (request->method() == HTTP_OPTIONS) {
+      request->send(200);
+    } else {
+      request->send(404);
+    }
+  });
 #else
   // Serve static resources from /www/
   server->serveStatic("/js/", ESPFS, "/www/js/");
@@ -83,6 +79,31 @@ ESP8266React::ESP8266React(AsyncWebServer* server) :
   DefaultHeaders::Instance().addHeader("Access-Control-Allow-Headers", "Accept, Content-Type, Authorization");
   DefaultHeaders::Instance().addHeader("Access-Control-Allow-Credentials", "true");
 #endif
+
+  addBatchSources();
+}
+
+// Status endpoints the UI polls together, so a dashboard can fetch them all with one request to /rest/batch
+void ESP8266React::addBatchSources() {
+  _batchService.addSource(
+      FEATURES_SERVICE_PATH,
+      [this]() { return _featureService.serializeFeatures(); },
+      AuthenticationPredicates::NONE_REQUIRED);
+  _batchService.addSource(SYSTEM_STATUS_SERVICE_PATH, [this]() { return _systemStatus.serializeStatus(); });
+  _batchService.addSource(WIFI_STATUS_SERVICE_PATH, [this]() { return _wifiStatus.serializeStatus(); });
+  _batchService.addSource(AP_STATUS_SERVICE_PATH, [this]() { return _apStatus.serializeStatus(); });
+#if FT_ENABLED(FT_NTP)
+  _batchService.addSource(NTP_STATUS_SERVICE_PATH, [this]() { return _ntpStatus.serializeStatus(); });
+#endif
+#if FT_ENABLED(FT_MQTT)
+  _batchService.addSource(MQTT_STATUS_SERVICE_PATH, [this]() { return _mqttStatus.serializeStatus(); });
+#endif
+#if FT_ENABLED(FT_BLE)
+  _batchService.addSource(
+      BLE_STATUS_PATH,
+      [this]() { return _bleStatus.serialize(BleStatusDataReader(), DEFAULT_BUFFER_SIZE); },
+      AuthenticationPredicates::IS_ADMIN);
+#endif
 }
 
 void ESP8266React::begin() {
@@ -90,6 +111,17 @@ void ESP8266React::begin() {
   ESPFS.begin(true);
 #elif defined(ESP8266)
   ESPFS.begin();
+#endif
+#ifdef ENABLE_CONFIG_STORE
+  // load every service's settings with a single read, services must be started after this
+  _configStore.begin();
+  FSPersistenceBase::setConfigStore(&_configStore);
+#endif
+#ifdef ENABLE_FLASH_JOURNAL
+  // services which enable the journal keep their settings in it, or in files if there is no journal partition
+  if (_flashJournal.begin()) {
+    FSPersistenceBase::setJournal(&_flashJournal);
+  }
 #endif
   _wifiSettingsService.begin();
   _apSettingsService.begin();
@@ -118,5 +150,29 @@ void ESP8266React::loop() {
 #endif
 #if FT_ENABLED(FT_MQTT)
   _mqttSettingsService.loop();
+#endif
+  propagatePendingUpdates();
+  FSPersistenceBase::loopAll();
+  WebSocketTxBase::loopAll();
+}
+
+// Delivers updates held back by a service's propagation window, see StatefulService::setPropagationWindow
+void ESP8266React::propagatePendingUpdates() {
+  _wifiSettingsService.propagatePendingUpdates();
+  _apSettingsService.propagatePendingUpdates();
+#if FT_ENABLED(FT_NTP)
+  _ntpSettingsService.propagatePendingUpdates();
+#endif
+#if FT_ENABLED(FT_OTA)
+  _otaSettingsService.propagatePendingUpdates();
+#endif
+#if FT_ENABLED(FT_MQTT)
+  _mqttSettingsService.propagatePendingUpdates();
+#endif
+#if FT_ENABLED(FT_BLE)
+  _bleSettingsService.propagatePendingUpdates();
+#endif
+#if FT_ENABLED(FT_SECURITY)
+  _securitySettingsService.propagatePendingUpdates();
 #endif
 }
@@ -12,6 +12,7 @@
 #endif
 
 #include <FeaturesService.h>
+#include <BatchService.h>
 #include <APSettingsService.h>
 #include <APStatus.h>
 #include <AuthenticationService.h>
@@ -29,6 +30,7 @@
 #include <WiFiScanner.h>
 #include <WiFiSettingsService.h>
 #include <WiFiStatus.h>
+#include <WebSocketTxRx.h>
 #include <ESPFS.h>
 
 #if FT_ENABLED(FT_BLE)
@@ -37,7 +39,7 @@
 #endif
 
 #ifdef PROGMEM_WWW
-#include <WWWData.h>
+#include <WWWDataHandler.h>
 #endif
 
 #ifndef CORS_ORIGIN
@@ -109,7 +111,18 @@ class ESP8266React {
     _factoryResetService.factoryReset();
   }
 
+  // Register further read-only endpoints here to have them served by /rest/batch
+  BatchService* getBatchService() {
+    return &_batchService;
+  }
+
  private:
+#ifdef ENABLE_CONFIG_STORE
+  FSConfigStore _configStore;
+#endif
+#ifdef ENABLE_FLASH_JOURNAL
+  FlashJournal _flashJournal;
+#endif
   FeaturesService _featureService;
   SecuritySettingsService _securitySettingsService;
   WiFiSettingsService _wifiSettingsService;
@@ -142,6 +155,13 @@ class ESP8266React {
   RestartService _restartService;
   FactoryResetService _factoryResetService;
   SystemStatus _systemStatus;
+  BatchService _batchService;
+#ifdef PROGMEM_WWW
+  WWWDataHandler _wwwDataHandler;
+#endif
+
+  void propagatePendingUpdates();
+  void addBatchSources();
 };
 
 #endif
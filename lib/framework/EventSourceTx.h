@@ -0,0 +1,95 @@
+#ifndef EventSourceTx_h
+#define EventSourceTx_h
+
+#include <StatefulService.h>
+#include <ESPAsyncWebServer.h>
+#include <SecurityManager.h>
+
+#define EVENT_SOURCE_PAYLOAD_EVENT "payload"
+
+// How long, in ms, a disconnected browser waits before reconnecting
+#ifndef EVENT_SOURCE_RECONNECT_DELAY
+#define EVENT_SOURCE_RECONNECT_DELAY 2000
+#endif
+
+/**
+ * Pushes the serialized state to Server-Sent Events clients whenever it changes, for read-only views which have no
+ * need of a WebSocket's return channel. Each client costs only an AsyncEventSourceClient and the payload is shared with
+ * the other transports through the service's payload cache.
+ *
+ * Every event carries an id derived from the state revision. A browser reconnecting with a Last-Event-ID matching the
+ * current revision already holds the latest state and is sent nothing. Ids are offset by a value chosen at startup, as
+ * revisions restart on every boot.
+ *
+ * EventSource can't set headers, so secured streams expect the access token as the access_token query parameter.
+ */
+template <class T, class StateReader = JsonStateReader<T>>
+class EventSourceTx {
+ public:
+  EventSourceTx(StateReader stateReader,
+                StatefulService<T>* statefulService,
+                AsyncWebServer* server,
+                const char* eventSourcePath,
+                SecurityManager* securityManager,
+                AuthenticationPredicate authenticationPredicate = AuthenticationPredicates::IS_ADMIN,
+                size_t bufferSize = DEFAULT_BUFFER_SIZE) :
+      _stateReader(stateReader),
+      _statefulService(statefulService),
+      _eventSource(eventSourcePath),
+      _bufferSize(bufferSize),
+      _eventIdBase(random(1, 2147483647)) {
+    _eventSource.setFilter(securityManager->filterRequest(authenticationPredicate));
+    begin(server);
+  }
+
+  EventSourceTx(StateReader stateReader,
+                StatefulService<T>* statefulService,
+                AsyncWebServer* server,
+                const char* eventSourcePath,
+                size_t bufferSize = DEFAULT_BUFFER_SIZE) :
+      _stateReader(stateReader),
+      _statefulService(statefulService),
+      _eventSource(eventSourcePath),
+      _bufferSize(bufferSize),
+      _eventIdBase(random(1, 2147483647)) {
+    begin(server);
+  }
+
+  size_t getClientCount() {
+    return _eventSource.count();
+  }
+
+ private:
+  StateReader _stateReader;
+  StatefulService<T>* _statefulService;
+  AsyncEventSource _eventSource;
+  size_t _bufferSize;
+  uint32_t _eventIdBase;
+
+  void begin(AsyncWebServer* server) {
+    _eventSource.onConnect(std::bind(&EventSourceTx::onConnect, this, std::placeholders::_1));
+    server->addHandler(&_eventSource);
+    _statefulService->addUpdateHandler([&](const String& originId) { transmitData(); }, false);
+  }
+
+  void onConnect(AsyncEventSourceClient* client) {
+    if (client->lastId() == _eventIdBase + _statefulService->getRevision()) {
+      return;
+    }
+    // the event id is the revision actually serialized, which may be newer than the one checked
+    uint32_t revision;
+    String payload = _statefulService->serialize(_stateReader, _bufferSize, &revision);
+    client->send(payload.c_str(), EVENT_SOURCE_PAYLOAD_EVENT, _eventIdBase + revision, EVENT_SOURCE_RECONNECT_DELAY);
+  }
+
+  void transmitData() {
+    if (_eventSource.count() == 0) {
+      return;
+    }
+    uint32_t revision;
+    String payload = _statefulService->serialize(_stateReader, _bufferSize, &revision);
+    _eventSource.send(payload.c_str(), EVENT_SOURCE_PAYLOAD_EVENT, _eventIdBase + revision);
+  }
+};
+
+#endif  // end EventSourceTx_h
@@ -0,0 +1,171 @@
+#include <FSConfigStore.h>
+#include <FSPersistence.h>
+
+FSConfigStore::FSConfigStore(FS* fs, const char* filePath) : _fs(fs), _filePath(filePath) {
+#ifdef ESP32
+  _accessMutex = xSemaphoreCreateRecursiveMutex();
+#endif
+}
+
+bool FSConfigStore::begin() {
+  beginTransaction();
+  bool loaded = readStore(_filePath);
+  if (!loaded) {
+    // the store may have been interrupted while being replaced, leaving the new version in the temporary file
+    String tempFilePath = String(_filePath) + FS_TEMP_FILE_SUFFIX;
+    if (_fs->exists(tempFilePath) && readStore(tempFilePath)) {
+      loaded = writeStore();
+    }
+  }
+  endTransaction();
+  return loaded;
+}
+
+bool FSConfigStore::get(const String& key, uint8_t& format, std::vector<uint8_t>& data) {
+  beginTransaction();
+  for (FSConfigStoreEntry_t& entry : _entries) {
+    if (entry.key == key) {
+      format = entry.format;
+      data = entry.data;
+      endTransaction();
+      return true;
+    }
+  }
+  endTransaction();
+  return false;
+}
+
+bool FSConfigStore::put(const String& key, uint8_t format, const uint8_t* data, size_t length) {
+  if (key.length() > 255) {
+    return false;
+  }
+  beginTransaction();
+  FSConfigStoreEntry_t* slot = nullptr;
+  for (FSConfigStoreEntry_t& entry : _entries) {
+    if (entry.key == key) {
+      slot = &entry;
+      break;
+    }
+  }
+  if (!slot) {
+    _entries.push_back(FSConfigStoreEntry_t());
+    slot = &_entries.back();
+    slot->key = key;
+  }
+  slot->format = format;
+  slot->data.assign(data, data + length);
+  bool written = writeStore();
+  endTransaction();
+  return written;
+}
+
+bool FSConfigStore::remove(const String& key) {
+  beginTransaction();
+  for (auto entry = _entries.begin(); entry != _entries.end(); entry++) {
+    if (entry->key == key) {
+      _entries.erase(entry);
+      bool written = writeStore();
+      endTransaction();
+      return written;
+    }
+  }
+  endTransaction();
+  return false;
+}
+
+bool FSConfigStore::readStore(const String& path) {
+  _entries.clear();
+  if (!_fs->exists(path)) {
+    return false;
+  }
+  File storeFile = _fs->open(path, "r");
+  if (!storeFile) {
+    return false;
+  }
+
+  // the whole store is read at once and validated before any record is parsed
+  FSPersistenceHeader_t header;
+  std::vector<uint8_t> records;
+  bool valid = storeFile.read((uint8_t*)&header, sizeof(header)) == sizeof(header) &&
+               header.magic == FS_CONFIG_STORE_MAGIC && header.version == FS_CONFIG_STORE_VERSION &&
+               storeFile.size() == sizeof(header) + header.length;
+  if (valid) {
+    records.resize(header.length);
+    valid = storeFile.read(records.data(), header.length) == header.length &&
+            Crc32::calculate(records.data(), header.length) == header.crc;
+  }
+  storeFile.close();
+
+  size_t offset = 0;
+  while (valid && offset < records.size()) {
+    FSConfigStoreEntry_t entry;
+    uint8_t keyLength = records[offset++];
+    uint32_t length;
+    if (records.size() - offset < (size_t)keyLength + 1 + sizeof(length)) {
+      valid = false;
+      break;
+    }
+    entry.key.reserve(keyLength);
+    for (uint8_t i = 0; i < keyLength; i++) {
+      entry.key += (char)records[offset++];
+    }
+    entry.format = records[offset++];
+    memcpy(&length, &records[offset], sizeof(length));
+    offset += sizeof(length);
+    if (records.size() - offset < length) {
+      valid = false;
+      break;
+    }
+    entry.data.assign(records.begin() + offset, records.begin() + offset + length);
+    offset += length;
+    _entries.push_back(entry);
+  }
+
+  if (!valid) {
+    Serial.printf("[FS] Ignoring corrupt config store: %s\n", path.c_str());
+    _entries.clear();
+  }
+  return valid;
+}
+
+bool FSConfigStore::writeStore() {
+  std::vector<uint8_t> records;
+  for (FSConfigStoreEntry_t& entry : _entries) {
+    uint32_t length = entry.data.size();
+    records.push_back((uint8_t)entry.key.length());
+    records.insert(records.end(), entry.key.c_str(), entry.key.c_str() + entry.key.length());
+    records.push_back(entry.format);
+    records.insert(records.end(), (const uint8_t*)&length, (const uint8_t*)&length + sizeof(length));
+    records.insert(records.end(), entry.data.begin(), entry.data.end());
+  }
+
+  FSPersistenceHeader_t header;
+  header.magic = FS_CONFIG_STORE_MAGIC;
+  header.version = FS_CONFIG_STORE_VERSION;
+  header.format = 0;
+  header.reserved = _entries.size();
+  header.length = records.size();
+  header.crc = Crc32::calculate(records.data(), records.size());
+
+  // make the parent directory if required
+  String path(_filePath);
+  String directory = path.substring(0, path.lastIndexOf('/'));
+  if (directory.length() > 0 && !_fs->exists(directory)) {
+    _fs->mkdir(directory);
+  }
+
+  // write to a temporary file and rename it over the store, so a power cut leaves either the old or new store
+  String tempFilePath = path + FS_TEMP_FILE_SUFFIX;
+  File storeFile = _fs->open(tempFilePath, "w");
+  if (!storeFile) {
+    return false;
+  }
+  bool written = storeFile.write((const uint8_t*)&header, sizeof(header)) == sizeof(header) &&
+                 storeFile.write(records.data(), records.size()) == records.size();
+  storeFile.close();
+  if (!written || !_fs->rename(tempFilePath, path)) {
+    _fs->remove(tempFilePath);
+    return false;
+  }
+  return true;
+}
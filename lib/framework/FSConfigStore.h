@@ -0,0 +1,74 @@
+#ifndef FSConfigStore_h
+#define FSConfigStore_h
+
+#include <Arduino.h>
+#include <FS.h>
+
+#include <vector>
+#ifdef ESP32
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#endif
+
+#ifndef FS_CONFIG_STORE_FILE
+#define FS_CONFIG_STORE_FILE "/config/store.bin"
+#endif
+
+#define FS_CONFIG_STORE_MAGIC 0x53435357  // "WSCS"
+#define FS_CONFIG_STORE_VERSION 1
+
+/**
+ * Holds the persisted state of every service in a single file, indexed by each service's own file path. The whole
+ * store is loaded with one read at boot, replacing a file open, header check and read per service, and services then
+ * load their state from memory.
+ *
+ * Every put rewrites the store (atomically, through a temporary file), so it suits settings which change rarely or
+ * services using write-behind. The file starts with the same header as an FSPersistence file, checksumming all
+ * records, followed by one record per key: key length (1 byte), key, format (1 byte), data length (4 bytes), data.
+ */
+class FSConfigStore {
+ public:
+  FSConfigStore(FS* fs, const char* filePath = FS_CONFIG_STORE_FILE);
+
+  // Loads the store, returning false if it was missing or corrupt in which case the store starts empty
+  bool begin();
+
+  // Copies the data stored under key, returning false if there is none
+  bool get(const String& key, uint8_t& format, std::vector<uint8_t>& data);
+
+  // Stores data under key and rewrites the store, returning false if the store could not be written
+  bool put(const String& key, uint8_t format, const uint8_t* data, size_t length);
+
+  bool remove(const String& key);
+
+ private:
+  typedef struct FSConfigStoreEntry {
+    String key;
+    uint8_t format;
+    std::vector<uint8_t> data;
+  } FSConfigStoreEntry_t;
+
+  FS* _fs;
+  const char* _filePath;
+  std::vector<FSConfigStoreEntry_t> _entries;
+#ifdef ESP32
+  SemaphoreHandle_t _accessMutex;
+#endif
+
+  bool readStore(const String& path);
+  bool writeStore();
+
+  inline void beginTransaction() {
+#ifdef ESP32
+    xSemaphoreTakeRecursive(_accessMutex, portMAX_DELAY);
+#endif
+  }
+
+  inline void endTransaction() {
+#ifdef ESP32
+    xSemaphoreGiveRecursive(_accessMutex);
+#endif
+  }
+};
+
+#endif  // end FSConfigStore_h
@@ -0,0 +1,55 @@
+#include <FSPersistence.h>
+
+FSPersistenceBase* FSPersistenceBase::_first = nullptr;
+FSConfigStore* FSPersistenceBase::_configStore = nullptr;
+FlashJournal* FSPersistenceBase::_journal = nullptr;
+bool FSPersistenceBase::_writesDisabled = false;
+
+FSPersistenceBase::FSPersistenceBase() : _next(_first) {
+  _first = this;
+}
+
+FSPersistenceBase::~FSPersistenceBase() {
+  for (FSPersistenceBase** persistence = &_first; *persistence; persistence = &(*persistence)->_next) {
+    if (*persistence == this) {
+      *persistence = _next;
+      break;
+    }
+  }
+}
+
+void FSPersistenceBase::loopAll() {
+  for (FSPersistenceBase* persistence = _first; persistence; persistence = persistence->_next) {
+    persistence->loop();
+  }
+  if (_journal) {
+    _journal->loop();
+  }
+}
+
+void FSPersistenceBase::flushAll() {
+  for (FSPersistenceBase* persistence = _first; persistence; persistence = persistence->_next) {
+    persistence->flush();
+  }
+}
+
+void FSPersistenceBase::discardAll() {
+  _writesDisabled = true;
+  for (FSPersistenceBase* persistence = _first; persistence; persistence = persistence->_next) {
+    persistence->discard();
+  }
+}
+
+void FSPersistenceBase::setConfigStore(FSConfigStore* configStore) {
+  _configStore = configStore;
+}
+
+void FSPersistenceBase::setJournal(FlashJournal* journal) {
+  _journal = journal;
+}
+
+void FSPersistenceBase::clearJournal() {
+  if (_journal) {
+    _journal->clear();
+  }
+}
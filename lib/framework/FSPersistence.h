@@ -2,13 +2,101 @@
 #define FSPersistence_h
 
 #include <StatefulService.h>
+#include <Crc32.h>
+#include <FSConfigStore.h>
+#include <FlashJournal.h>
 #include <FS.h>
 
-template <class T>
-class FSPersistence {
+// Default write-behind delay in ms, zero writes every change through to the file system immediately
+#ifndef FS_WRITE_BEHIND_DELAY
+#define FS_WRITE_BEHIND_DELAY 0
+#endif
+
+// Default upper bound in ms on how long a change may wait for its write while further changes keep arriving
+#ifndef FS_WRITE_BEHIND_MAX_LATENCY
+#define FS_WRITE_BEHIND_MAX_LATENCY 5000
+#endif
+
+// Appended to the file path while a new version of the file is written
+#define FS_TEMP_FILE_SUFFIX ".tmp"
+
+#define FS_PERSISTENCE_MAGIC 0x46435357  // "WSCF"
+#define FS_PERSISTENCE_VERSION 1
+
+// Encoding of the state within a persisted file, recorded in the header's format field
+enum class FSPersistenceFormat : uint8_t {
+  JSON = 0,  // Human readable, the representation shared with the other transports
+  MSGPACK    // MessagePack, more compact and faster to parse
+};
+
+/**
+ * Written ahead of the serialized state so a torn or corrupt file can be detected before it is parsed. Files without
+ * a header (those starting with '{') are legacy JSON files and are still read, gaining a header on their next write.
+ */
+typedef struct FSPersistenceHeader {
+  uint32_t magic;
+  uint8_t version;
+  uint8_t format;
+  uint16_t reserved;
+  uint32_t length;
+  uint32_t crc;
+} FSPersistenceHeader_t;
+
+/**
+ * Tracks every FSPersistence instance, whatever its state type, so pending write-behind changes can be flushed from
+ * the main loop and before the device restarts.
+ */
+class FSPersistenceBase {
  public:
-  FSPersistence(JsonStateReader<T> stateReader,
-                JsonStateUpdater<T> stateUpdater,
+  // Writes pending changes which have reached their delay or maximum latency, call regularly from the main loop
+  static void loopAll();
+
+  // Writes all pending changes immediately, called before a restart
+  static void flushAll();
+
+  /**
+   * Drops all pending changes and stops every further write until the device restarts, called by a factory reset
+   * before it removes the files so none are written back
+   */
+  static void discardAll();
+
+  /**
+   * Keeps every service's state in the given consolidated store instead of its own file. Must be set before services
+   * read their state, existing files are moved into the store as they are read.
+   */
+  static void setConfigStore(FSConfigStore* configStore);
+
+  /**
+   * Keeps the state of services which call enableJournal() in the given journal instead of a file. Must be set before
+   * services read their state, existing files are moved into the journal as they are read.
+   */
+  static void setJournal(FlashJournal* journal);
+
+  // Erases the journal, if any, called by a factory reset along with removing the files
+  static void clearJournal();
+
+ protected:
+  static FSConfigStore* _configStore;
+  static FlashJournal* _journal;
+  static bool _writesDisabled;
+
+  FSPersistenceBase();
+  virtual ~FSPersistenceBase();
+
+  virtual void loop() = 0;
+  virtual void flush() = 0;
+  virtual void discard() = 0;
+
+ private:
+  static FSPersistenceBase* _first;
+  FSPersistenceBase* _next;
+};
+
+template <class T, class StateReader = JsonStateReader<T>, class StateUpdater = JsonStateUpdater<T>>
+class FSPersistence : public FSPersistenceBase {
+ public:
+  FSPersistence(StateReader stateReader,
+                StateUpdater stateUpdater,
                 StatefulService<T>* statefulService,
                 FS* fs,
                 const char* filePath,
@@ -19,23 +107,205 @@ class FSPersistence {
       _fs(fs),
       _filePath(filePath),
       _bufferSize(bufferSize),
-      _updateHandlerId(0) {
+      _updateHandlerId(0),
+      _writeDelay(FS_WRITE_BEHIND_DELAY),
+      _maxLatency(FS_WRITE_BEHIND_MAX_LATENCY),
+      _dirty(false),
+      _firstChange(0),
+      _lastChange(0),
+      _writeCount(0),
+      _writesAvoided(0),
+      _maxFlushLatency(0),
+      _maxWriteMicros(0),
+      _format(FSPersistenceFormat::JSON),
+      _persisted(false),
+      _persistedFormat(0),
+      _persistedLength(0),
+      _persistedCrc(0),
+      _skippedWrites(0),
+      _journaled(false),
+      _inJournal(false),
+      _unsavedFields(0),
+      _changeRecordCount(0) {
     enableUpdateHandler();
   }
 
+  /**
+   * Selects the encoding used when writing the file. Files are read in whichever format they were written, and
+   * readFromFS() rewrites a file held in another format (or without a header) so existing files migrate on first boot.
+   */
+  void setFormat(FSPersistenceFormat format) {
+    _format = format;
+  }
+
+  FSPersistenceFormat getFormat() {
+    return _format;
+  }
+
+  /**
+   * Enables write-behind. Rather than rewriting the file on every change, changes mark the state dirty and the file
+   * is written once no further change has arrived for delayMs, or once maxLatencyMs has passed since the first
+   * unwritten change. Pending changes are flushed before a restart and discarded by a factory reset. A delay of zero
+   * writes every change immediately.
+   */
+  void setWriteBehind(uint32_t delayMs, uint32_t maxLatencyMs = FS_WRITE_BEHIND_MAX_LATENCY) {
+    _writeDelay = delayMs;
+    _maxLatency = maxLatencyMs;
+    if (!delayMs) {
+      flush();
+    }
+  }
+
+  /**
+   * Saves the state to the journal set with setJournal() rather than its own file or the config store, if there is a
+   * journal. Suits services which change often: a save appends a record to erased flash instead of rewriting a file.
+   */
+  void enableJournal() {
+    _journaled = true;
+  }
+
+  /**
+   * Saves changes made by a delta updater to the journal as change records, holding only the changed fields, rather
+   * than as the whole state. The delta updater applies the records when the state is read back, so must remain set
+   * for as long as the journal may hold them.
+   */
+  void setDeltaReader(JsonStateDeltaReader<T> deltaReader) {
+    _deltaReader = deltaReader;
+  }
+
+  void setDeltaUpdater(JsonStateDeltaUpdater<T> deltaUpdater) {
+    _deltaUpdater = deltaUpdater;
+  }
+
+  bool isDirty() {
+    return _dirty;
+  }
+
+  // Writes the pending change, if any, to the file system now
+  void flush() {
+    if (!_dirty) {
+      return;
+    }
+    // cleared before serializing, so a change arriving during the write marks the state dirty again
+    _dirty = false;
+    uint32_t latency = millis() - _firstChange;
+    if (latency > _maxFlushLatency) {
+      _maxFlushLatency = latency;
+    }
+    writeToFS();
+  }
+
+  // Number of times the file has been written
+  uint32_t getWriteCount() {
+    return _writeCount;
+  }
+
+  // Number of changes folded into a pending write rather than written on their own
+  uint32_t getWritesAvoided() {
+    return _writesAvoided;
+  }
+
+  // Longest time in ms a change has waited to be written
+  uint32_t getMaxFlushLatency() {
+    return _maxFlushLatency;
+  }
+
+  // Longest time in us taken to write the file
+  uint32_t getMaxWriteMicros() {
+    return _maxWriteMicros;
+  }
+
+  // Number of writes skipped because the serialized state matched what was last persisted
+  uint32_t getSkippedWrites() {
+    return _skippedWrites;
+  }
+
+  // Number of writes saved to the journal as a change record
+  uint32_t getChangeRecordCount() {
+    return _changeRecordCount;
+  }
+
   void readFromFS() {
-    File settingsFile = _fs->open(_filePath, "r");
-
-    if (settingsFile) {
-      DynamicJsonDocument jsonDocument = DynamicJsonDocument(_bufferSize);
-      DeserializationError error = deserializeJson(jsonDocument, settingsFile);
-      if (error == DeserializationError::Ok && jsonDocument.is<JsonObject>()) {
-        JsonObject jsonObject = jsonDocument.as<JsonObject>();
-        _statefulService->updateWithoutPropagation(jsonObject, _stateUpdater);
-        settingsFile.close();
+    DeserializationError error = DeserializationError::EmptyInput;
+    if (journal()) {
+      uint8_t format;
+      std::vector<uint8_t> data;
+      std::vector<std::vector<uint8_t>> changes;
+      if (_journal->get(_filePath, format, data, changes)) {
+        error = applyPayload(format, (const char*)data.data(), data.size());
+        for (size_t i = 0; !error && i < changes.size(); i++) {
+          error = applyPayload(format, (const char*)changes[i].data(), changes[i].size(), true);
+        }
+        if (!error) {
+          _inJournal = true;
+          if (changes.empty()) {
+            setPersisted(format, data.size(), Crc32::calculate(data.data(), data.size()));
+          }
+          if (format != (uint8_t)_format) {
+            writeToFS();
+          }
+          return;
+        }
+      }
+    }
+    if (_configStore && error == DeserializationError::EmptyInput) {
+      uint8_t format;
+      std::vector<uint8_t> data;
+      if (_configStore->get(_filePath, format, data)) {
+        error = applyPayload(format, (const char*)data.data(), data.size());
+        if (!error) {
+          if (journal()) {
+            // move the state from the store into the journal
+            if (writeToFS()) {
+              _configStore->remove(_filePath);
+            }
+            return;
+          }
+          setPersisted(format, data.size(), Crc32::calculate(data.data(), data.size()));
+          if (format != (uint8_t)_format) {
+            writeToFS();
+          }
+          return;
+        }
+      }
+    }
+
+    bool current = false;
+    if (error != DeserializationError::NoMemory) {
+      error = readFile(_filePath, current);
+      if (!error) {
+        if (journal() || _configStore) {
+          // move the file into the journal or store
+          _persisted = false;
+          if (writeToFS()) {
+            _fs->remove(_filePath);
+          }
+        } else if (!current) {
+          writeToFS();
+        }
         return;
       }
-      settingsFile.close();
+    }
+
+    // A missing or corrupt file may have been interrupted while being replaced, in which case the new version is
+    // complete in the temporary file. It is loaded and written back under the real name.
+    String tempFilePath = String(_filePath) + FS_TEMP_FILE_SUFFIX;
+    if (error != DeserializationError::NoMemory && _fs->exists(tempFilePath)) {
+      error = readFile(tempFilePath, current);
+      if (!error) {
+        _persisted = false;
+        writeToFS();
+        return;
+      }
+    }
+
+    // The stored state is intact but could not be parsed in the memory available. Defaults are applied so the service
+    // can run, but nothing is written back, so the stored state is not lost and is loaded again on the next boot.
+    if (error == DeserializationError::NoMemory) {
+      Serial.printf("[FS] Not enough memory to load %s, leaving it unchanged\n", _filePath);
+      applyDefaults();
+      disableUpdateHandler();
+      return;
     }
 
     // If we reach here we have not been successful in loading the config and hard-coded defaults are now applied.
@@ -46,25 +316,64 @@ class FSPersistence {
   }
 
   bool writeToFS() {
-    // create and populate a new json object
-    DynamicJsonDocument jsonDocument = DynamicJsonDocument(_bufferSize);
-    JsonObject jsonObject = jsonDocument.to<JsonObject>();
-    _statefulService->read(jsonObject, _stateReader);
+    if (_writesDisabled) {
+      return false;
+    }
+    unsigned long startedAt = micros();
+    state_field_mask_t changedFields = _unsavedFields;
+    _unsavedFields = 0;
 
-    // make directories if required
-    mkdirs();
+    // a change made by a delta updater is appended as a change record while the journal holds the state it changes
+    if (_inJournal && _deltaReader && changedFields && changedFields != STATE_FIELDS_ALL) {
+      std::unique_ptr<DynamicJsonDocument> jsonDocument = _statefulService->readDocument(
+          [&](T& settings, JsonObject& root) { _deltaReader(settings, root, changedFields); }, _bufferSize);
+      std::unique_ptr<uint8_t[]> buffer;
+      size_t length = encode(*jsonDocument, buffer);
+      if (_journal->putChange(_filePath, (uint8_t)_format, buffer.get(), length)) {
+        // the bytes persisted are no longer those of a whole payload, so the next whole payload is always written
+        _persisted = false;
+        _changeRecordCount++;
+        recordWrite(startedAt);
+        return true;
+      }
+    }
 
-    // serialize it to filesystem
-    File settingsFile = _fs->open(_filePath, "w");
+    // serialize the state, sharing the cached payload with the other transports when stored as JSON
+    String payload;
+    std::unique_ptr<uint8_t[]> buffer;
+    const uint8_t* data;
+    size_t length;
+    if (_format == FSPersistenceFormat::MSGPACK) {
+      std::unique_ptr<DynamicJsonDocument> jsonDocument = _statefulService->readDocument(_stateReader, _bufferSize);
+      length = encode(*jsonDocument, buffer);
+      data = buffer.get();
+    } else {
+      payload = _statefulService->serialize(_stateReader, _bufferSize);
+      data = (const uint8_t*)payload.c_str();
+      length = payload.length();
+    }
 
-    // failed to open file, return false
-    if (!settingsFile) {
-      return false;
+    // skip the write entirely if the bytes are those already persisted
+    uint32_t crc = Crc32::calculate(data, length);
+    if (_persisted && _persistedFormat == (uint8_t)_format && _persistedLength == length && _persistedCrc == crc) {
+      _skippedWrites++;
+      return true;
     }
 
-    // serialize the data to the file
-    serializeJson(jsonDocument, settingsFile);
-    settingsFile.close();
+    bool written;
+    if (journal()) {
+      written = _journal->put(_filePath, (uint8_t)_format, data, length);
+      _inJournal = written;
+    } else {
+      written = _configStore ? _configStore->put(_filePath, (uint8_t)_format, data, length)
+                             : writeFile(data, length, crc);
+    }
+    if (!written) {
+      _persisted = false;
+      return false;
+    }
+    setPersisted((uint8_t)_format, length, crc);
+    recordWrite(startedAt);
     return true;
   }
 
@@ -77,19 +386,206 @@ class FSPersistence {
 
   void enableUpdateHandler() {
     if (!_updateHandlerId) {
-      _updateHandlerId = _statefulService->addUpdateHandler([&](const String& originId) { writeToFS(); });
+      _updateHandlerId = _statefulService->addUpdateHandler(
+          [&](const String& originId, state_field_mask_t changedFields) { onStateUpdated(changedFields); });
     }
   }
 
  private:
-  JsonStateReader<T> _stateReader;
-  JsonStateUpdater<T> _stateUpdater;
+  StateReader _stateReader;
+  StateUpdater _stateUpdater;
   StatefulService<T>* _statefulService;
   FS* _fs;
   const char* _filePath;
   size_t _bufferSize;
   update_handler_id_t _updateHandlerId;
 
+  uint32_t _writeDelay;
+  uint32_t _maxLatency;
+  volatile bool _dirty;
+  unsigned long _firstChange;
+  unsigned long _lastChange;
+  uint32_t _writeCount;
+  uint32_t _writesAvoided;
+  uint32_t _maxFlushLatency;
+  uint32_t _maxWriteMicros;
+  FSPersistenceFormat _format;
+
+  // identifies the bytes last read from or written to the file system, so identical writes can be skipped
+  bool _persisted;
+  uint8_t _persistedFormat;
+  uint32_t _persistedLength;
+  uint32_t _persistedCrc;
+  uint32_t _skippedWrites;
+
+  // whether the state is kept in the journal, and whether the journal holds the state as last written
+  bool _journaled;
+  bool _inJournal;
+  JsonStateDeltaReader<T> _deltaReader;
+  JsonStateDeltaUpdater<T> _deltaUpdater;
+  state_field_mask_t _unsavedFields;
+  uint32_t _changeRecordCount;
+
+  FlashJournal* journal() {
+    return _journaled ? _journal : nullptr;
+  }
+
+  void recordWrite(unsigned long startedAt) {
+    uint32_t elapsed = micros() - startedAt;
+    _writeCount++;
+    if (elapsed > _maxWriteMicros) {
+      _maxWriteMicros = elapsed;
+    }
+  }
+
+  // Serializes a document in the configured format
+  size_t encode(JsonDocument& jsonDocument, std::unique_ptr<uint8_t[]>& buffer) {
+    if (_format == FSPersistenceFormat::MSGPACK) {
+      size_t length = measureMsgPack(jsonDocument);
+      buffer.reset(new uint8_t[length]);
+      return serializeMsgPack(jsonDocument, (char*)buffer.get(), length);
+    }
+    // serializeJson() terminates the output, which needs room of its own
+    size_t length = measureJson(jsonDocument);
+    buffer.reset(new uint8_t[length + 1]);
+    return serializeJson(jsonDocument, (char*)buffer.get(), length + 1);
+  }
+
+  void setPersisted(uint8_t format, uint32_t length, uint32_t crc) {
+    _persisted = true;
+    _persistedFormat = format;
+    _persistedLength = length;
+    _persistedCrc = crc;
+  }
+
+  void onStateUpdated(state_field_mask_t changedFields) {
+    _unsavedFields |= changedFields;
+    if (!_writeDelay) {
+      writeToFS();
+      return;
+    }
+    unsigned long now = millis();
+    _lastChange = now;
+    if (_dirty) {
+      _writesAvoided++;
+      return;
+    }
+    _firstChange = now;
+    _dirty = true;
+  }
+
+  // Writes the data to the service's own file, preceded by a header
+  bool writeFile(const uint8_t* data, size_t length, uint32_t crc) {
+    // make directories if required
+    mkdirs();
+
+    FSPersistenceHeader_t header;
+    header.magic = FS_PERSISTENCE_MAGIC;
+    header.version = FS_PERSISTENCE_VERSION;
+    header.format = (uint8_t)_format;
+    header.reserved = 0;
+    header.length = length;
+    header.crc = crc;
+
+    // write to a temporary file, so a power cut mid-write leaves the existing file untouched
+    String tempFilePath = String(_filePath) + FS_TEMP_FILE_SUFFIX;
+    File settingsFile = _fs->open(tempFilePath, "w");
+
+    // failed to open file, return false
+    if (!settingsFile) {
+      return false;
+    }
+
+    // write the header followed by the data
+    bool written = settingsFile.write((const uint8_t*)&header, sizeof(header)) == sizeof(header) &&
+                   settingsFile.write(data, length) == length;
+    settingsFile.close();
+
+    // the rename replaces the previous file in a single step
+    if (!written || !_fs->rename(tempFilePath, _filePath)) {
+      _fs->remove(tempFilePath);
+      return false;
+    }
+    return true;
+  }
+
+  /**
+   * Loads the state from the given file, returning EmptyInput if it is missing, InvalidInput if it is torn or corrupt
+   * and NoMemory if it is too large to parse. Sets current to whether the file has a header and is held in the
+   * configured format.
+   */
+  DeserializationError readFile(const String& path, bool& current) {
+    File settingsFile = _fs->open(path, "r");
+    if (!settingsFile) {
+      return DeserializationError::EmptyInput;
+    }
+
+    FSPersistenceHeader_t header;
+    std::unique_ptr<char[]> payload;
+    bool valid = false;
+    if (settingsFile.peek() == '{') {
+      // a legacy file, written as plain JSON before the header was introduced
+      header.magic = 0;
+      header.format = (uint8_t)FSPersistenceFormat::JSON;
+      header.length = settingsFile.size();
+      payload.reset(new char[header.length]);
+      valid = settingsFile.read((uint8_t*)payload.get(), header.length) == header.length;
+    } else if (settingsFile.read((uint8_t*)&header, sizeof(header)) == sizeof(header) &&
+               header.magic == FS_PERSISTENCE_MAGIC && header.version == FS_PERSISTENCE_VERSION &&
+               settingsFile.size() == sizeof(header) + header.length) {
+      // the length and checksum are validated before anything is parsed
+      payload.reset(new char[header.length]);
+      valid = settingsFile.read((uint8_t*)payload.get(), header.length) == header.length &&
+              Crc32::calculate((const uint8_t*)payload.get(), header.length) == header.crc;
+    }
+    settingsFile.close();
+
+    DeserializationError error = valid ? applyPayload(header.format, payload.get(), header.length)
+                                       : DeserializationError::InvalidInput;
+    if (error == DeserializationError::NoMemory) {
+      return error;
+    }
+    if (error) {
+      Serial.printf("[FS] Ignoring corrupt file: %s\n", path.c_str());
+      return error;
+    }
+    current = header.magic == FS_PERSISTENCE_MAGIC && header.format == (uint8_t)_format;
+    if (current) {
+      setPersisted(header.format, header.length, header.crc);
+    }
+    return error;
+  }
+
+  /**
+   * Parses data held in the given format, in a document sized for it, and applies it to the state. A change record is
+   * applied with the delta updater, leaving fields it does not hold unchanged.
+   */
+  DeserializationError applyPayload(uint8_t format, const char* data, size_t length, bool change = false) {
+    if (change && !_deltaUpdater) {
+      return DeserializationError::InvalidInput;
+    }
+    std::unique_ptr<DynamicJsonDocument> jsonDocument;
+    DeserializationError error = DeserializationError::InvalidInput;
+    if (format == (uint8_t)FSPersistenceFormat::MSGPACK) {
+      error = JsonUtils::readMsgPack(jsonDocument, data, length, _bufferSize);
+    } else if (format == (uint8_t)FSPersistenceFormat::JSON) {
+      error = JsonUtils::readJson(jsonDocument, data, length, _bufferSize);
+    }
+    if (error) {
+      return error;
+    }
+    if (!jsonDocument->is<JsonObject>()) {
+      return DeserializationError::InvalidInput;
+    }
+    JsonObject jsonObject = jsonDocument->as<JsonObject>();
+    if (change) {
+      _statefulService->updateWithoutPropagation(jsonObject, _deltaUpdater);
+    } else {
+      _statefulService->updateWithoutPropagation(jsonObject, _stateUpdater);
+    }
+    return error;
+  }
+
   // We assume we have a _filePath with format "/directory1/directory2/filename"
   // We create a directory for each missing parent
   void mkdirs() {
@@ -104,6 +600,21 @@ class FSPersistence {
   }
 
  protected:
+  void discard() {
+    _dirty = false;
+    _unsavedFields = 0;
+  }
+
+  void loop() {
+    if (!_dirty) {
+      return;
+    }
+    unsigned long now = millis();
+    if (now - _lastChange >= _writeDelay || now - _firstChange >= _maxLatency) {
+      flush();
+    }
+  }
+
   // We assume the updater supplies sensible defaults if an empty object
   // is supplied, this virtual function allows that to be changed.
   virtual void applyDefaults() {
@@ -10,7 +10,7 @@ FactoryResetService::FactoryResetService(AsyncWebServer* server, FS* fs, Securit
 }
 
 void FactoryResetService::handleRequest(AsyncWebServerRequest* request) {
-  request->onDisconnect(std::bind(&FactoryResetService::factoryReset, this));
+  RequestGovernor::onDisconnect(request, std::bind(&FactoryResetService::factoryReset, this));
   request->send(200);
 }
 
@@ -18,6 +18,9 @@ void FactoryResetService::handleRequest(AsyncWebServerRequest* request) {
  * Delete function assumes that all files are stored flat, within the config directory.
  */
 void FactoryResetService::factoryReset() {
+  // drop pending changes and stop writes, so nothing is written back once the files are removed
+  FSPersistenceBase::discardAll();
+  FSPersistenceBase::clearJournal();
 #ifdef ESP32
   File root = fs->open(FS_CONFIG_DIRECTORY);
   File file;
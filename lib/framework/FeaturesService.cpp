@@ -1,12 +1,16 @@
 #include <FeaturesService.h>
 
-FeaturesService::FeaturesService(AsyncWebServer* server) {
+// features are fixed at compile time, so they are serialized once and never refreshed
+FeaturesService::FeaturesService(AsyncWebServer* server) :
+    _statusCache(std::bind(&FeaturesService::readFeatures, this, std::placeholders::_1), MAX_FEATURES_SIZE, 0) {
   server->on(FEATURES_SERVICE_PATH, HTTP_GET, std::bind(&FeaturesService::features, this, std::placeholders::_1));
 }
 
 void FeaturesService::features(AsyncWebServerRequest* request) {
-  AsyncJsonResponse* response = new AsyncJsonResponse(false, MAX_FEATURES_SIZE);
-  JsonObject root = response->getRoot();
+  request->send(200, JSON_MIMETYPE, _statusCache.serialize());
+}
+
+void FeaturesService::readFeatures(JsonObject& root) {
 #if FT_ENABLED(FT_PROJECT)
   root["project"] = true;
 #else
@@ -42,6 +46,4 @@ void FeaturesService::features(AsyncWebServerRequest* request) {
 #else
   root["ble"] = false;
 #endif
-  response->setLength();
-  request->send(response);
 }
@@ -14,6 +14,7 @@
 #include <ArduinoJson.h>
 #include <AsyncJson.h>
 #include <ESPAsyncWebServer.h>
+#include <StatusCache.h>
 
 #define MAX_FEATURES_SIZE 256
 #define FEATURES_SERVICE_PATH "/rest/features"
@@ -22,8 +23,15 @@ class FeaturesService {
  public:
   FeaturesService(AsyncWebServer* server);
 
+  String serializeFeatures() {
+    return _statusCache.serialize();
+  }
+
  private:
+  StatusCache _statusCache;
+
   void features(AsyncWebServerRequest* request);
+  void readFeatures(JsonObject& root);
 };
 
 #endif
@@ -0,0 +1,449 @@
+#include <FlashJournal.h>
+#include <Crc32.h>
+
+#include <algorithm>
+
+FlashJournal::FlashJournal(const char* partitionLabel) :
+    _partitionLabel(partitionLabel),
+#ifdef ESP32
+    _partition(nullptr),
+#endif
+    _head(0),
+    _sectorSequence(0),
+    _recordSequence(0),
+    _liveSize(0),
+    _reclaiming(false),
+    _eraseCount(0),
+    _appendCount(0),
+    _movedCount(0) {
+#ifdef ESP32
+  _accessMutex = xSemaphoreCreateRecursiveMutex();
+#endif
+}
+
+bool FlashJournal::begin() {
+  beginTransaction();
+  _sequences.clear();
+  _ends.clear();
+  _index.clear();
+  _liveSize = 0;
+  size_t sectors = 0;
+#ifdef ESP32
+  _partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, _partitionLabel);
+  if (_partition) {
+    sectors = _partition->size / FLASH_JOURNAL_SECTOR_SIZE;
+  }
+#endif
+  // the reserve, the sector being appended to and at least one more are needed for reclaiming to make progress
+  if (sectors < FLASH_JOURNAL_RESERVED_SECTORS + 3) {
+    endTransaction();
+    return false;
+  }
+  _sequences.assign(sectors, 0);
+  _ends.assign(sectors, 0);
+
+  // sectors in use are identified first, anything else not completely erased is erased now
+  std::vector<size_t> order;
+  for (size_t sector = 0; sector < sectors; sector++) {
+    FlashJournalSectorHeader_t header;
+    bool erased = readFlash(sector * FLASH_JOURNAL_SECTOR_SIZE, &header, sizeof(header));
+    if (header.magic == FLASH_JOURNAL_MAGIC && header.version == FLASH_JOURNAL_VERSION && header.sequence &&
+        header.crc == Crc32::calculate((const uint8_t*)&header, offsetof(FlashJournalSectorHeader_t, crc))) {
+      _sequences[sector] = header.sequence;
+      _sectorSequence = std::max(_sectorSequence, header.sequence);
+      order.push_back(sector);
+      continue;
+    }
+    uint32_t words[64];
+    for (size_t offset = 0; erased && offset < FLASH_JOURNAL_SECTOR_SIZE; offset += sizeof(words)) {
+      erased = readFlash(sector * FLASH_JOURNAL_SECTOR_SIZE + offset, words, sizeof(words));
+      for (size_t i = 0; erased && i < 64; i++) {
+        erased = words[i] == 0xFFFFFFFF;
+      }
+    }
+    if (!erased && !eraseSector(sector)) {
+      Serial.printf("[Journal] Failed to erase sector %d\n", (int)sector);
+      _sequences.clear();
+      _ends.clear();
+      endTransaction();
+      return false;
+    }
+  }
+
+  // records are replayed oldest sector first, the last sector opened is the one appended to
+  std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return _sequences[a] < _sequences[b]; });
+  std::map<uint32_t, std::vector<FlashJournalEntry_t>> found;
+  for (size_t sector : order) {
+    scanSector(sector, found);
+  }
+  _head = order.empty() ? 0 : order.back();
+  buildIndex(found);
+  endTransaction();
+  return true;
+}
+
+bool FlashJournal::get(const String& key,
+                       uint8_t& format,
+                       std::vector<uint8_t>& data,
+                       std::vector<std::vector<uint8_t>>& changes) {
+  beginTransaction();
+  auto chain = _index.find(keyOf(key));
+  bool found = chain != _index.end();
+  if (found) {
+    changes.resize(chain->second.size() - 1);
+    found = readRecord(chain->second[0], data, nullptr);
+    for (size_t i = 1; found && i < chain->second.size(); i++) {
+      found = readRecord(chain->second[i], changes[i - 1], nullptr);
+    }
+    format = chain->second[0].format;
+  }
+  endTransaction();
+  return found;
+}
+
+bool FlashJournal::put(const String& key, uint8_t format, const uint8_t* data, size_t length) {
+  if (!isReady() || recordSize(length) > FLASH_JOURNAL_MAX_RECORD_SIZE) {
+    return false;
+  }
+  beginTransaction();
+  std::vector<FlashJournalEntry_t>& chain = _index[keyOf(key)];
+  size_t superseded = 0;
+  for (FlashJournalEntry_t& entry : chain) {
+    superseded += entry.size;
+  }
+  FlashJournalRecordHeader_t header;
+  header.key = keyOf(key);
+  header.sequence = _recordSequence + 1;
+  header.length = length;
+  header.format = format;
+  header.type = (uint8_t)FlashJournalRecord::FULL;
+  header.dataCrc = Crc32::calculate(data, length);
+  header.crc = headerCrc(header);
+  FlashJournalEntry_t entry;
+  bool written = _liveSize - superseded + recordSize(length) <= capacity() && append(header, data, entry);
+  if (written) {
+    _recordSequence = header.sequence;
+    _liveSize = _liveSize - superseded + entry.size;
+    _appendCount++;
+    chain.assign(1, entry);
+  } else if (chain.empty()) {
+    _index.erase(header.key);
+  }
+  endTransaction();
+  return written;
+}
+
+bool FlashJournal::putChange(const String& key, uint8_t format, const uint8_t* data, size_t length) {
+  if (!isReady() || recordSize(length) > FLASH_JOURNAL_MAX_RECORD_SIZE) {
+    return false;
+  }
+  beginTransaction();
+  auto chain = _index.find(keyOf(key));
+  bool written = chain != _index.end() && chain->second[0].format == format &&
+                 chain->second.size() <= FLASH_JOURNAL_MAX_CHANGES && _liveSize + recordSize(length) <= capacity();
+  if (written) {
+    FlashJournalRecordHeader_t header;
+    header.key = chain->first;
+    header.sequence = _recordSequence + 1;
+    header.length = length;
+    header.format = format;
+    header.type = (uint8_t)FlashJournalRecord::CHANGE;
+    header.dataCrc = Crc32::calculate(data, length);
+    header.crc = headerCrc(header);
+    FlashJournalEntry_t entry;
+    written = append(header, data, entry);
+    if (written) {
+      _recordSequence = header.sequence;
+      _liveSize += entry.size;
+      _appendCount++;
+      chain->second.push_back(entry);
+    }
+  }
+  endTransaction();
+  return written;
+}
+
+bool FlashJournal::clear() {
+  beginTransaction();
+  bool erased = true;
+  for (size_t sector = 0; sector < _sequences.size(); sector++) {
+    erased = eraseSector(sector) && erased;
+  }
+  _index.clear();
+  _liveSize = 0;
+  endTransaction();
+  return erased;
+}
+
+void FlashJournal::loop() {
+  if (!isReady()) {
+    return;
+  }
+  beginTransaction();
+  if (getFreeSectors() <= FLASH_JOURNAL_RESERVED_SECTORS + 1 && victim() >= 0) {
+    reclaim();
+  }
+  endTransaction();
+}
+
+size_t FlashJournal::getFreeSectors() {
+  return std::count(_sequences.begin(), _sequences.end(), 0);
+}
+
+uint32_t FlashJournal::keyOf(const String& key) {
+  return Crc32::calculate((const uint8_t*)key.c_str(), key.length());
+}
+
+uint32_t FlashJournal::headerCrc(const FlashJournalRecordHeader_t& header) {
+  return Crc32::calculate((const uint8_t*)&header, offsetof(FlashJournalRecordHeader_t, crc));
+}
+
+size_t FlashJournal::recordSize(size_t length) {
+  return (sizeof(FlashJournalRecordHeader_t) + length + 3) & ~(size_t)3;
+}
+
+/**
+ * Live records may fill half of every sector but the reserve, the sector being appended to and one more. A record
+ * which does not fit in what is left of a sector goes to the next, and as records are at most half a sector no sector
+ * is left less than half full, so whenever the erased sectors run down to the reserve there are superseded records
+ * waiting to be reclaimed.
+ */
+size_t FlashJournal::capacity() {
+  return (_sequences.size() - FLASH_JOURNAL_RESERVED_SECTORS - 2) * FLASH_JOURNAL_MAX_RECORD_SIZE;
+}
+
+/**
+ * Adds the intact records of a sector to those found so far. Scanning ends at the first erased header, where the next
+ * record would have been appended, or at a torn header, in which case nothing more is appended to the sector.
+ */
+void FlashJournal::scanSector(size_t sector, std::map<uint32_t, std::vector<FlashJournalEntry_t>>& found) {
+  size_t offset = sizeof(FlashJournalSectorHeader_t);
+  std::vector<uint8_t> data;
+  while (offset + sizeof(FlashJournalRecordHeader_t) <= FLASH_JOURNAL_SECTOR_SIZE) {
+    FlashJournalRecordHeader_t header;
+    if (!readFlash(sector * FLASH_JOURNAL_SECTOR_SIZE + offset, &header, sizeof(header))) {
+      offset = FLASH_JOURNAL_SECTOR_SIZE;
+      break;
+    }
+    const uint8_t* bytes = (const uint8_t*)&header;
+    if (std::all_of(bytes, bytes + sizeof(header), [](uint8_t byte) { return byte == 0xFF; })) {
+      break;
+    }
+    size_t size = recordSize(header.length);
+    if (header.crc != headerCrc(header) || offset + size > FLASH_JOURNAL_SECTOR_SIZE) {
+      offset = FLASH_JOURNAL_SECTOR_SIZE;
+      break;
+    }
+    FlashJournalEntry_t entry;
+    entry.sector = sector;
+    entry.offset = offset;
+    entry.size = size;
+    entry.format = header.format;
+    entry.type = header.type;
+    entry.sequence = header.sequence;
+    if (readRecord(entry, data, nullptr)) {
+      found[header.key].push_back(entry);
+    }
+    _recordSequence = std::max(_recordSequence, header.sequence);
+    offset += size;
+  }
+  _ends[sector] = offset;
+}
+
+/**
+ * Keeps each key's latest full record and the change records appended after it. A record found twice, because power
+ * was lost while its sector was being reclaimed, is taken from the sector opened last.
+ */
+void FlashJournal::buildIndex(std::map<uint32_t, std::vector<FlashJournalEntry_t>>& found) {
+  for (auto& records : found) {
+    std::vector<FlashJournalEntry_t>& entries = records.second;
+    std::stable_sort(entries.begin(), entries.end(), [](const FlashJournalEntry_t& a, const FlashJournalEntry_t& b) {
+      return a.sequence < b.sequence;
+    });
+    std::vector<FlashJournalEntry_t> chain;
+    for (FlashJournalEntry_t& entry : entries) {
+      if (!chain.empty() && chain.back().sequence == entry.sequence) {
+        chain.back() = entry;
+      } else if (entry.type == (uint8_t)FlashJournalRecord::FULL) {
+        chain.assign(1, entry);
+      } else if (!chain.empty() && entry.type == (uint8_t)FlashJournalRecord::CHANGE &&
+                 entry.format == chain[0].format) {
+        chain.push_back(entry);
+      }
+    }
+    if (!chain.empty()) {
+      for (FlashJournalEntry_t& entry : chain) {
+        _liveSize += entry.size;
+      }
+      _index[records.first] = chain;
+    }
+  }
+}
+
+// Programs the header ahead of the data, into the sector being appended to or a newly opened one
+bool FlashJournal::append(const FlashJournalRecordHeader_t& header, const uint8_t* data, FlashJournalEntry_t& entry) {
+  size_t size = recordSize(header.length);
+  if (!_sequences[_head] || _ends[_head] + size > FLASH_JOURNAL_SECTOR_SIZE) {
+    if (!openSector()) {
+      return false;
+    }
+  }
+  entry.sector = _head;
+  entry.offset = _ends[_head];
+  entry.size = size;
+  entry.format = header.format;
+  entry.type = header.type;
+  entry.sequence = header.sequence;
+  // the space is taken even if programming fails, flash which may be partly programmed is never written again
+  _ends[_head] += size;
+  size_t address = entry.sector * FLASH_JOURNAL_SECTOR_SIZE + entry.offset;
+  return writeFlash(address, &header, sizeof(header)) &&
+         writeFlash(address + sizeof(header), data, header.length);
+}
+
+/**
+ * Opens the next erased sector for appending, first reclaiming a sector if only the reserve is left. While reclaiming
+ * the reserve itself may be opened.
+ */
+bool FlashJournal::openSector() {
+  if (!_reclaiming) {
+    for (size_t attempt = 0; getFreeSectors() <= FLASH_JOURNAL_RESERVED_SECTORS && attempt < _sequences.size();
+         attempt++) {
+      if (!reclaim()) {
+        break;
+      }
+    }
+    if (getFreeSectors() <= FLASH_JOURNAL_RESERVED_SECTORS) {
+      Serial.printf("[Journal] No sector could be reclaimed\n");
+      return false;
+    }
+  }
+  size_t sector = _head;
+  do {
+    sector = (sector + 1) % _sequences.size();
+  } while (_sequences[sector] && sector != _head);
+  if (_sequences[sector]) {
+    return false;
+  }
+
+  FlashJournalSectorHeader_t header;
+  header.magic = FLASH_JOURNAL_MAGIC;
+  header.version = FLASH_JOURNAL_VERSION;
+  memset(header.reserved, 0, sizeof(header.reserved));
+  header.sequence = _sectorSequence + 1;
+  header.crc = Crc32::calculate((const uint8_t*)&header, offsetof(FlashJournalSectorHeader_t, crc));
+  _sectorSequence = header.sequence;
+  _sequences[sector] = header.sequence;
+  _ends[sector] = FLASH_JOURNAL_SECTOR_SIZE;
+  _head = sector;
+  if (!writeFlash(sector * FLASH_JOURNAL_SECTOR_SIZE, &header, sizeof(header))) {
+    return false;
+  }
+  _ends[sector] = sizeof(header);
+  return true;
+}
+
+/**
+ * The oldest sector, other than the one being appended to, holding superseded records, or -1 if there is none. Taking
+ * sectors oldest first erases them in turn, while a sector holding only live records is left alone as erasing it would
+ * free no space.
+ */
+int FlashJournal::victim() {
+  std::vector<size_t> live(_sequences.size(), 0);
+  for (auto& chain : _index) {
+    for (FlashJournalEntry_t& entry : chain.second) {
+      live[entry.sector] += entry.size;
+    }
+  }
+  int victim = -1;
+  for (size_t sector = 0; sector < _sequences.size(); sector++) {
+    if (!_sequences[sector] || sector == _head || _ends[sector] - sizeof(FlashJournalSectorHeader_t) == live[sector]) {
+      continue;
+    }
+    if (victim < 0 || _sequences[sector] < _sequences[victim]) {
+      victim = sector;
+    }
+  }
+  return victim;
+}
+
+/**
+ * Moves the live records out of the victim sector, unchanged, then erases it. Power lost part way leaves both copies,
+ * which begin() resolves in favour of the moved one.
+ */
+bool FlashJournal::reclaim() {
+  int sector = victim();
+  if (sector < 0) {
+    return false;
+  }
+  _reclaiming = true;
+  bool moved = true;
+  std::vector<uint8_t> data;
+  for (auto chain = _index.begin(); moved && chain != _index.end(); chain++) {
+    for (FlashJournalEntry_t& entry : chain->second) {
+      if (entry.sector != sector) {
+        continue;
+      }
+      FlashJournalRecordHeader_t header;
+      moved = readRecord(entry, data, &header) && append(header, data.data(), entry);
+      if (!moved) {
+        break;
+      }
+      _movedCount++;
+    }
+  }
+  _reclaiming = false;
+  return moved && eraseSector(sector);
+}
+
+// Reads a record's data, returning false if either checksum does not match
+bool FlashJournal::readRecord(const FlashJournalEntry_t& entry,
+                              std::vector<uint8_t>& data,
+                              FlashJournalRecordHeader_t* header) {
+  FlashJournalRecordHeader_t recordHeader;
+  size_t address = entry.sector * FLASH_JOURNAL_SECTOR_SIZE + entry.offset;
+  if (!readFlash(address, &recordHeader, sizeof(recordHeader)) || recordHeader.crc != headerCrc(recordHeader)) {
+    return false;
+  }
+  data.resize(recordHeader.length);
+  if (!readFlash(address + sizeof(recordHeader), data.data(), data.size()) ||
+      Crc32::calculate(data.data(), data.size()) != recordHeader.dataCrc) {
+    return false;
+  }
+  if (header) {
+    *header = recordHeader;
+  }
+  return true;
+}
+
+bool FlashJournal::readFlash(size_t address, void* data, size_t length) {
+#ifdef ESP32
+  return esp_partition_read(_partition, address, data, length) == ESP_OK;
+#else
+  return false;
+#endif
+}
+
+bool FlashJournal::writeFlash(size_t address, const void* data, size_t length) {
+#ifdef ESP32
+  return !length || esp_partition_write(_partition, address, data, length) == ESP_OK;
+#else
+  return false;
+#endif
+}
+
+// Erases a sector, leaving it in use but closed to appends if the erase fails
+bool FlashJournal::eraseSector(size_t sector) {
+  _ends[sector] = FLASH_JOURNAL_SECTOR_SIZE;
+#ifdef ESP32
+  if (esp_partition_erase_range(_partition, sector * FLASH_JOURNAL_SECTOR_SIZE, FLASH_JOURNAL_SECTOR_SIZE) != ESP_OK) {
+    return false;
+  }
+#else
+  return false;
+#endif
+  _sequences[sector] = 0;
+  _ends[sector] = 0;
+  _eraseCount++;
+  return true;
+}
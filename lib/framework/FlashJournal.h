@@ -0,0 +1,189 @@
+#ifndef FlashJournal_h
+#define FlashJournal_h
+
+#include <Arduino.h>
+
+#include <map>
+#include <vector>
+#ifdef ESP32
+#include <esp_partition.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#endif
+
+// Label of the data partition holding the journal, see partitions_journal.csv
+#ifndef FLASH_JOURNAL_PARTITION
+#define FLASH_JOURNAL_PARTITION "journal"
+#endif
+
+// Change records a key may accumulate before its next save must be written in full
+#ifndef FLASH_JOURNAL_MAX_CHANGES
+#define FLASH_JOURNAL_MAX_CHANGES 32
+#endif
+
+// Erased sectors held back so the oldest sector can always be reclaimed
+#define FLASH_JOURNAL_RESERVED_SECTORS 1
+
+#define FLASH_JOURNAL_SECTOR_SIZE 4096
+// Largest record, header included, so a sector never holds less than half its size in records
+#define FLASH_JOURNAL_MAX_RECORD_SIZE ((FLASH_JOURNAL_SECTOR_SIZE - sizeof(FlashJournalSectorHeader_t)) / 2)
+#define FLASH_JOURNAL_MAGIC 0x4A465357  // "WSFJ"
+#define FLASH_JOURNAL_VERSION 1
+
+// Kind of record, a change record only holds what changed since the records before it
+enum class FlashJournalRecord : uint8_t { FULL = 0, CHANGE };
+
+/**
+ * Starts every sector in use. The sequence orders sectors from oldest to newest, a sector whose header is erased
+ * (all 0xFF) is free.
+ */
+typedef struct FlashJournalSectorHeader {
+  uint32_t magic;
+  uint8_t version;
+  uint8_t reserved[3];
+  uint32_t sequence;
+  uint32_t crc;
+} FlashJournalSectorHeader_t;
+
+/**
+ * Precedes the data of every record, records are 4 byte aligned and at most FLASH_JOURNAL_MAX_RECORD_SIZE. The header
+ * is programmed before the data and carries its own checksum, so a torn header ends the sector and torn data only loses
+ * that record. The sequence orders a key's records and is kept when a record is moved to another sector.
+ */
+typedef struct FlashJournalRecordHeader {
+  uint32_t key;
+  uint32_t sequence;
+  uint16_t length;
+  uint8_t format;
+  uint8_t type;
+  uint32_t dataCrc;
+  uint32_t crc;
+} FlashJournalRecordHeader_t;
+
+/**
+ * Appends settings to a raw flash partition as checksummed records, each key holding its latest full record and the
+ * change records saved since. Appends go into erased flash, so a save costs no erase of its own. A sector is erased
+ * only when it is reclaimed to make room, taking the oldest sector holding superseded records and moving its live
+ * records to the newest sector first. Sectors are reclaimed and reopened in turn, spreading erases over the partition.
+ *
+ * LittleFS copies a file's partly filled last block into a newly erased block on every synced append, which is why the
+ * journal keeps to its own partition instead of a file. The index of live records is held in memory and rebuilt by
+ * begin(), which scans every sector once.
+ */
+class FlashJournal {
+ public:
+  FlashJournal(const char* partitionLabel = FLASH_JOURNAL_PARTITION);
+
+  // Finds the partition and rebuilds the index, returning false if there is no usable partition
+  bool begin();
+
+  bool isReady() {
+    return !_sequences.empty();
+  }
+
+  /**
+   * Copies the latest full record stored under key, and the data of the change records appended after it oldest
+   * first, returning false if there is none
+   */
+  bool get(const String& key, uint8_t& format, std::vector<uint8_t>& data, std::vector<std::vector<uint8_t>>& changes);
+
+  /**
+   * Appends a full record, superseding everything previously stored under key. Returns false if the data is too large
+   * for a record or the journal is full.
+   */
+  bool put(const String& key, uint8_t format, const uint8_t* data, size_t length);
+
+  /**
+   * Appends a change record to those stored under key. Returns false, appending nothing, if the key has no full record
+   * in the same format or has reached FLASH_JOURNAL_MAX_CHANGES, in which case the state should be saved with put().
+   */
+  bool putChange(const String& key, uint8_t format, const uint8_t* data, size_t length);
+
+  // Erases the whole partition, dropping every key
+  bool clear();
+
+  /**
+   * Reclaims a sector ahead of need once the erased sectors run down to one more than the reserve, so saves rarely
+   * wait for an erase. Call regularly from the main loop.
+   */
+  void loop();
+
+  // Number of sectors erased since boot
+  uint32_t getEraseCount() {
+    return _eraseCount;
+  }
+
+  // Number of records appended since boot, not counting those moved when reclaiming a sector
+  uint32_t getAppendCount() {
+    return _appendCount;
+  }
+
+  // Number of live records moved out of sectors being reclaimed
+  uint32_t getMovedCount() {
+    return _movedCount;
+  }
+
+  size_t getFreeSectors();
+
+ private:
+  // A record in the index, records stored under a key are kept oldest first with the full record leading
+  typedef struct FlashJournalEntry {
+    uint16_t sector;
+    uint16_t offset;
+    uint16_t size;
+    uint8_t format;
+    uint8_t type;
+    uint32_t sequence;
+  } FlashJournalEntry_t;
+
+  const char* _partitionLabel;
+#ifdef ESP32
+  const esp_partition_t* _partition;
+  SemaphoreHandle_t _accessMutex;
+#endif
+  // sequence of each sector, zero while the sector is erased
+  std::vector<uint32_t> _sequences;
+  // offset at which the next record is appended to each sector
+  std::vector<uint16_t> _ends;
+  size_t _head;
+  uint32_t _sectorSequence;
+  uint32_t _recordSequence;
+  size_t _liveSize;
+  bool _reclaiming;
+  std::map<uint32_t, std::vector<FlashJournalEntry_t>> _index;
+
+  uint32_t _eraseCount;
+  uint32_t _appendCount;
+  uint32_t _movedCount;
+
+  static uint32_t keyOf(const String& key);
+  static uint32_t headerCrc(const FlashJournalRecordHeader_t& header);
+  static size_t recordSize(size_t length);
+
+  size_t capacity();
+  void scanSector(size_t sector, std::map<uint32_t, std::vector<FlashJournalEntry_t>>& found);
+  void buildIndex(std::map<uint32_t, std::vector<FlashJournalEntry_t>>& found);
+  bool append(const FlashJournalRecordHeader_t& header, const uint8_t* data, FlashJournalEntry_t& entry);
+  bool openSector();
+  int victim();
+  bool reclaim();
+  bool readRecord(const FlashJournalEntry_t& entry, std::vector<uint8_t>& data, FlashJournalRecordHeader_t* header);
+
+  bool readFlash(size_t address, void* data, size_t length);
+  bool writeFlash(size_t address, const void* data, size_t length);
+  bool eraseSector(size_t sector);
+
+  inline void beginTransaction() {
+#ifdef ESP32
+    xSemaphoreTakeRecursive(_accessMutex, portMAX_DELAY);
+#endif
+  }
+
+  inline void endTransaction() {
+#ifdef ESP32
+    xSemaphoreGiveRecursive(_accessMutex);
+#endif
+  }
+};
+
+#endif  // end FlashJournal_h
@@ -6,57 +6,123 @@
 #include <AsyncJson.h>
 #include <ESPAsyncWebServer.h>
 
+#include <ChunkedJsonResponse.h>
+#include <JsonUtils.h>
+#include <MsgPackResponse.h>
+#include <JsonBodyWebHandler.h>
 #include <SecurityManager.h>
 #include <StatefulService.h>
 
 #define HTTP_ENDPOINT_ORIGIN_ID "http"
 
-template <class T>
+#define ETAG_HEADER "ETag"
+#define IF_NONE_MATCH_HEADER "If-None-Match"
+#define CACHE_CONTROL_HEADER "Cache-Control"
+#define VARY_HEADER "Vary"
+
+/**
+ * Endpoints use std::function readers and updaters by default. Pass StaticJsonStateReader / StaticJsonStateUpdater
+ * types as the optional template arguments to bind them at compile time instead.
+ *
+ * Clients may exchange MessagePack rather than JSON, by sending "Accept: application/msgpack" and posting with
+ * "Content-Type: application/msgpack". The same readers and updaters are used for both.
+ */
+template <class T, class StateReader = JsonStateReader<T>>
 class HttpGetEndpoint {
  public:
-  HttpGetEndpoint(JsonStateReader<T> stateReader,
+  HttpGetEndpoint(StateReader stateReader,
                   StatefulService<T>* statefulService,
                   AsyncWebServer* server,
                   const String& servicePath,
                   SecurityManager* securityManager,
                   AuthenticationPredicate authenticationPredicate = AuthenticationPredicates::IS_ADMIN,
                   size_t bufferSize = DEFAULT_BUFFER_SIZE) :
-      _stateReader(stateReader), _statefulService(statefulService), _bufferSize(bufferSize) {
+      _stateReader(stateReader),
+      _statefulService(statefulService),
+      _bufferSize(bufferSize),
+      _etagPrefix(createEtagPrefix()) {
     server->on(servicePath.c_str(),
                HTTP_GET,
                securityManager->wrapRequest(std::bind(&HttpGetEndpoint::fetchSettings, this, std::placeholders::_1),
                                             authenticationPredicate));
   }
 
-  HttpGetEndpoint(JsonStateReader<T> stateReader,
+  HttpGetEndpoint(StateReader stateReader,
                   StatefulService<T>* statefulService,
                   AsyncWebServer* server,
                   const String& servicePath,
                   size_t bufferSize = DEFAULT_BUFFER_SIZE) :
-      _stateReader(stateReader), _statefulService(statefulService), _bufferSize(bufferSize) {
+      _stateReader(stateReader),
+      _statefulService(statefulService),
+      _bufferSize(bufferSize),
+      _etagPrefix(createEtagPrefix()) {
     server->on(servicePath.c_str(), HTTP_GET, std::bind(&HttpGetEndpoint::fetchSettings, this, std::placeholders::_1));
   }
 
  protected:
-  JsonStateReader<T> _stateReader;
+  StateReader _stateReader;
   StatefulService<T>* _statefulService;
   size_t _bufferSize;
+  String _etagPrefix;
+
+  /**
+   * Revisions restart from zero on every boot, so the ETag is prefixed with a random value chosen at startup. This
+   * stops a client revalidating a response cached before a restart against an unrelated state with the same revision.
+   */
+  static String createEtagPrefix() {
+    return "\"" + String(random(2147483647), HEX) + "-";
+  }
+
+  // The MessagePack representation has its own ETag, as its body differs from the JSON one
+  String createEtag(uint32_t revision, bool msgPack) {
+    return _etagPrefix + String(revision) + (msgPack ? "-m\"" : "\"");
+  }
 
+  /**
+   * Responds with 304 Not Modified, without reading or serializing the state, when the client already holds the
+   * current revision.
+   */
   void fetchSettings(AsyncWebServerRequest* request) {
-    AsyncJsonResponse* response = new AsyncJsonResponse(false, _bufferSize);
-    JsonObject jsonObject = response->getRoot().to<JsonObject>();
-    _statefulService->read(jsonObject, _stateReader);
+    bool msgPack = MsgPackResponse::accepted(request);
+    String etag = createEtag(_statefulService->getRevision(), msgPack);
+    const AsyncWebHeader* ifNoneMatch = request->getHeader(IF_NONE_MATCH_HEADER);
+    if (ifNoneMatch && ifNoneMatch->value() == etag) {
+      AsyncWebServerResponse* response = request->beginResponse(304);
+      response->addHeader(ETAG_HEADER, etag);
+      response->addHeader(CACHE_CONTROL_HEADER, "no-cache");
+      response->addHeader(VARY_HEADER, ACCEPT_HEADER);
+      request->send(response);
+      return;
+    }
 
-    response->setLength();
+    // the body is labelled with the revision actually read, which may be newer than the one checked above
+    uint32_t revision;
+    AsyncWebServerResponse* response;
+    if (msgPack) {
+      std::unique_ptr<DynamicJsonDocument> jsonDocument =
+          _statefulService->readDocument(_stateReader, _bufferSize, 0, &revision);
+      response = MsgPackResponse::begin(request, *jsonDocument);
+    } else if (_statefulService->getJsonCapacity() > CHUNKED_RESPONSE_THRESHOLD) {
+      // large states are serialized from the document as the connection takes each chunk, never as a whole string
+      std::unique_ptr<DynamicJsonDocument> jsonDocument =
+          _statefulService->readDocument(_stateReader, _bufferSize, 0, &revision);
+      response = ChunkedJsonResponse::begin(request, std::move(jsonDocument));
+    } else {
+      String payload = _statefulService->serialize(_stateReader, _bufferSize, &revision);
+      response = request->beginResponse(200, JSON_MIMETYPE, payload);
+    }
+    response->addHeader(ETAG_HEADER, createEtag(revision, msgPack));
+    response->addHeader(CACHE_CONTROL_HEADER, "no-cache");
+    response->addHeader(VARY_HEADER, ACCEPT_HEADER);
     request->send(response);
   }
 };
 
-template <class T>
+template <class T, class StateReader = JsonStateReader<T>, class StateUpdater = JsonStateUpdater<T>>
 class HttpPostEndpoint {
  public:
-  HttpPostEndpoint(JsonStateReader<T> stateReader,
-                   JsonStateUpdater<T> stateUpdater,
+  HttpPostEndpoint(StateReader stateReader,
+                   StateUpdater stateUpdater,
                    StatefulService<T>* statefulService,
                    AsyncWebServer* server,
                    const String& servicePath,
@@ -73,12 +139,13 @@ class HttpPostEndpoint {
               authenticationPredicate),
           bufferSize),
       _bufferSize(bufferSize) {
-    _updateHandler.setMethod(HTTP_POST);
+    _updateHandler.setMethod(HTTP_POST | HTTP_PATCH);
+    _updateHandler.setRequestFilter(securityManager->filterRequest(authenticationPredicate));
     server->addHandler(&_updateHandler);
   }
 
-  HttpPostEndpoint(JsonStateReader<T> stateReader,
-                   JsonStateUpdater<T> stateUpdater,
+  HttpPostEndpoint(StateReader stateReader,
+                   StateUpdater stateUpdater,
                    StatefulService<T>* statefulService,
                    AsyncWebServer* server,
                    const String& servicePath,
@@ -90,15 +157,21 @@ class HttpPostEndpoint {
                      std::bind(&HttpPostEndpoint::updateSettings, this, std::placeholders::_1, std::placeholders::_2),
                      bufferSize),
       _bufferSize(bufferSize) {
-    _updateHandler.setMethod(HTTP_POST);
+    _updateHandler.setMethod(HTTP_POST | HTTP_PATCH);
     server->addHandler(&_updateHandler);
   }
 
+  // Applies posted settings with a delta updater, so changed fields are tracked for delta transmission
+  void setDeltaUpdater(JsonStateDeltaUpdater<T> deltaUpdater) {
+    _deltaUpdater = deltaUpdater;
+  }
+
  protected:
-  JsonStateReader<T> _stateReader;
-  JsonStateUpdater<T> _stateUpdater;
+  StateReader _stateReader;
+  StateUpdater _stateUpdater;
+  JsonStateDeltaUpdater<T> _deltaUpdater;
   StatefulService<T>* _statefulService;
-  AsyncCallbackJsonWebHandler _updateHandler;
+  JsonBodyWebHandler _updateHandler;
   size_t _bufferSize;
 
   void updateSettings(AsyncWebServerRequest* request, JsonVariant& json) {
@@ -107,58 +180,98 @@ class HttpPostEndpoint {
       return;
     }
     JsonObject jsonObject = json.as<JsonObject>();
-    StateUpdateResult outcome = _statefulService->updateWithoutPropagation(jsonObject, _stateUpdater);
+
+    int errorCode = 400;
+    StateUpdateResult outcome;
+    if (request->method() == HTTP_PATCH) {
+      outcome = patchSettings(jsonObject, json.memoryUsage(), errorCode);
+    } else {
+      outcome = _deltaUpdater ? _statefulService->updateWithoutPropagation(jsonObject, _deltaUpdater)
+                              : _statefulService->updateWithoutPropagation(jsonObject, _stateUpdater);
+    }
     if (outcome == StateUpdateResult::ERROR) {
-      request->send(400);
+      request->send(errorCode);
       return;
     }
     if (outcome == StateUpdateResult::CHANGED) {
-      request->onDisconnect([this]() { _statefulService->callUpdateHandlers(HTTP_ENDPOINT_ORIGIN_ID); });
+      RequestGovernor::onDisconnect(request,
+                                    [this]() { _statefulService->callUpdateHandlers(HTTP_ENDPOINT_ORIGIN_ID); });
     }
-    AsyncJsonResponse* response = new AsyncJsonResponse(false, _bufferSize);
-    jsonObject = response->getRoot().to<JsonObject>();
-    _statefulService->read(jsonObject, _stateReader);
-    response->setLength();
-    request->send(response);
+
+    // answer in MessagePack when it was asked for, or posted without asking for anything else
+    if (MsgPackResponse::accepted(request) ||
+        (request->contentType().equalsIgnoreCase(MSGPACK_MIMETYPE) && !request->hasHeader(ACCEPT_HEADER))) {
+      std::unique_ptr<DynamicJsonDocument> jsonDocument = _statefulService->readDocument(_stateReader, _bufferSize);
+      request->send(MsgPackResponse::begin(request, *jsonDocument));
+      return;
+    }
+    request->send(200, JSON_MIMETYPE, _statefulService->serialize(_stateReader, _bufferSize));
+  }
+
+  /**
+   * A PATCH holds only the fields to change. The current state is read, the patch merged into it and the result applied
+   * as if it were posted, all in one transaction so no other update can land in between. The merged document is sized
+   * for the state plus everything in the patch, which is parsed with its strings copied so patchSize accounts for them.
+   */
+  StateUpdateResult patchSettings(JsonObject& patch, size_t patchSize, int& errorCode) {
+    return _statefulService->updateWithoutPropagation(
+        [&](T& settings, state_field_mask_t& changedFields) {
+          std::unique_ptr<DynamicJsonDocument> mergedDocument =
+              _statefulService->readDocument(_stateReader, _bufferSize, patchSize);
+          JsonObject mergedObject = mergedDocument->as<JsonObject>();
+          JsonUtils::mergePatch(mergedObject, patch);
+          if (mergedDocument->overflowed()) {
+            // a document which could not be allocated is our problem, one which is simply too small is the patch's
+            errorCode = mergedDocument->capacity() ? 413 : 500;
+            return StateUpdateResult::ERROR;
+          }
+          return _deltaUpdater ? _deltaUpdater(mergedObject, settings, changedFields)
+                               : _stateUpdater(mergedObject, settings);
+        });
   }
 };
 
-template <class T>
-class HttpEndpoint : public HttpGetEndpoint<T>, public HttpPostEndpoint<T> {
+template <class T, class StateReader = JsonStateReader<T>, class StateUpdater = JsonStateUpdater<T>>
+class HttpEndpoint : public HttpGetEndpoint<T, StateReader>, public HttpPostEndpoint<T, StateReader, StateUpdater> {
  public:
-  HttpEndpoint(JsonStateReader<T> stateReader,
-               JsonStateUpdater<T> stateUpdater,
+  HttpEndpoint(StateReader stateReader,
+               StateUpdater stateUpdater,
                StatefulService<T>* statefulService,
                AsyncWebServer* server,
                const String& servicePath,
                SecurityManager* securityManager,
                AuthenticationPredicate authenticationPredicate = AuthenticationPredicates::IS_ADMIN,
                size_t bufferSize = DEFAULT_BUFFER_SIZE) :
-      HttpGetEndpoint<T>(stateReader,
-                         statefulService,
-                         server,
-                         servicePath,
-                         securityManager,
-                         authenticationPredicate,
-                         bufferSize),
-      HttpPostEndpoint<T>(stateReader,
-                          stateUpdater,
-                          statefulService,
-                          server,
-                          servicePath,
-                          securityManager,
-                          authenticationPredicate,
-                          bufferSize) {
+      HttpGetEndpoint<T, StateReader>(stateReader,
+                                      statefulService,
+                                      server,
+                                      servicePath,
+                                      securityManager,
+                                      authenticationPredicate,
+                                      bufferSize),
+      HttpPostEndpoint<T, StateReader, StateUpdater>(stateReader,
+                                                     stateUpdater,
+                                                     statefulService,
+                                                     server,
+                                                     servicePath,
+                                                     securityManager,
+                                                     authenticationPredicate,
+                                                     bufferSize) {
   }
 
-  HttpEndpoint(JsonStateReader<T> stateReader,
-               JsonStateUpdater<T> stateUpdater,
+  HttpEndpoint(StateReader stateReader,
+               StateUpdater stateUpdater,
                StatefulService<T>* statefulService,
                AsyncWebServer* server,
                const String& servicePath,
                size_t bufferSize = DEFAULT_BUFFER_SIZE) :
-      HttpGetEndpoint<T>(stateReader, statefulService, server, servicePath, bufferSize),
-      HttpPostEndpoint<T>(stateReader, stateUpdater, statefulService, server, servicePath, bufferSize) {
+      HttpGetEndpoint<T, StateReader>(stateReader, statefulService, server, servicePath, bufferSize),
+      HttpPostEndpoint<T, StateReader, StateUpdater>(stateReader,
+                                                     stateUpdater,
+                                                     statefulService,
+                                                     server,
+                                                     servicePath,
+                                                     bufferSize) {
   }
 };
 
@@ -0,0 +1,76 @@
+#include <JsonBodyWebHandler.h>
+
+JsonBodyWebHandler::JsonBodyWebHandler(const String& uri, ArJsonRequestHandlerFunction onRequest, size_t bufferSize) :
+    _uri(uri),
+    _onRequest(onRequest),
+    _bufferSize(bufferSize),
+    _method(HTTP_POST),
+    _maxContentLength(DEFAULT_BODY_MAX_CONTENT_LENGTH) {
+}
+
+bool JsonBodyWebHandler::canHandle(AsyncWebServerRequest* request) {
+  if (!(_method & request->method()) || request->url() != _uri ||
+      !(request->contentType().equalsIgnoreCase(JSON_MIMETYPE) ||
+        request->contentType().equalsIgnoreCase(MSGPACK_MIMETYPE))) {
+    return false;
+  }
+  // keep the headers, the handler checks Authorization and Accept
+  request->addInterestingHeader("ANY");
+  return true;
+}
+
+void JsonBodyWebHandler::handleBody(AsyncWebServerRequest* request,
+                                    uint8_t* data,
+                                    size_t len,
+                                    size_t index,
+                                    size_t total) {
+  if (total > _maxContentLength) {
+    return;
+  }
+  // an unauthenticated client can't hold a place or heap by sending its body slowly, it is answered by handleRequest
+  if (index == 0 && _requestFilter && !_requestFilter(request)) {
+    return;
+  }
+  // take the request's place with the governor before the body is allocated, a refused body is never buffered
+  if (index == 0 && !RequestGovernor::reserve(request)) {
+    return;
+  }
+  // the request frees _tempObject when it is destroyed
+  if (index == 0 && !request->_tempObject) {
+    request->_tempObject = malloc(total);
+  }
+  if (request->_tempObject) {
+    memcpy((uint8_t*)request->_tempObject + index, data, len);
+  }
+}
+
+void JsonBodyWebHandler::handleRequest(AsyncWebServerRequest* request) {
+  if (_requestFilter && !_requestFilter(request)) {
+    request->send(401);
+    return;
+  }
+  if (request->contentLength() > _maxContentLength) {
+    request->send(413);
+    return;
+  }
+  if (!request->_tempObject) {
+    if (request->contentLength() && !RequestGovernor::isAdmitted(request)) {
+      RequestGovernor::refuse(request);
+    } else {
+      request->send(400);
+    }
+    return;
+  }
+  std::unique_ptr<DynamicJsonDocument> jsonDocument;
+  const char* body = (const char*)request->_tempObject;
+  DeserializationError error = request->contentType().equalsIgnoreCase(MSGPACK_MIMETYPE)
+                                   ? JsonUtils::readMsgPack(jsonDocument, body, request->contentLength(), _bufferSize)
+                                   : JsonUtils::readJson(jsonDocument, body, request->contentLength(), _bufferSize);
+  if (error) {
+    // too large to parse is reported as such, rather than as a malformed body
+    request->send(error == DeserializationError::NoMemory ? 413 : 400);
+    return;
+  }
+  JsonVariant json = jsonDocument->as<JsonVariant>();
+  _onRequest(request, json);
+}
@@ -0,0 +1,58 @@
+#ifndef JsonBodyWebHandler_h
+#define JsonBodyWebHandler_h
+
+#include <AsyncJson.h>
+#include <ESPAsyncWebServer.h>
+#include <JsonUtils.h>
+#include <MsgPackResponse.h>
+#include <RequestGovernor.h>
+
+#ifndef DEFAULT_BODY_MAX_CONTENT_LENGTH
+#define DEFAULT_BODY_MAX_CONTENT_LENGTH 16384
+#endif
+
+/**
+ * Counterpart to AsyncCallbackJsonWebHandler for bodies sent as JSON or, with "Content-Type: application/msgpack", as
+ * MessagePack. The body is parsed into a document sized for it rather than one of a fixed size (see
+ * JsonUtils::readJson) and passed to an ArJsonRequestHandlerFunction, so a JSON update callback accepts either encoding
+ * and state larger than the buffer size can still be posted.
+ *
+ * The request is admitted by the RequestGovernor before its body is buffered, and refused with 503 if the governor
+ * turns it away, so the wrapped callback's own admission finds the place already taken. With a request filter set
+ * (see SecurityManager::filterRequest) the request is authenticated first: one which fails it is answered with 401,
+ * taking no place and buffering none of its body.
+ */
+class JsonBodyWebHandler : public AsyncWebHandler {
+ public:
+  JsonBodyWebHandler(const String& uri, ArJsonRequestHandlerFunction onRequest, size_t bufferSize);
+
+  void setMethod(WebRequestMethodComposite method) {
+    _method = method;
+  }
+
+  void setMaxContentLength(size_t maxContentLength) {
+    _maxContentLength = maxContentLength;
+  }
+
+  void setRequestFilter(ArRequestFilterFunction requestFilter) {
+    _requestFilter = requestFilter;
+  }
+
+  bool canHandle(AsyncWebServerRequest* request) override;
+  void handleRequest(AsyncWebServerRequest* request) override;
+  void handleBody(AsyncWebServerRequest* request, uint8_t* data, size_t len, size_t index, size_t total) override;
+
+  bool isRequestHandlerTrivial() override {
+    return false;
+  }
+
+ private:
+  String _uri;
+  ArJsonRequestHandlerFunction _onRequest;
+  size_t _bufferSize;
+  WebRequestMethodComposite _method;
+  size_t _maxContentLength;
+  ArRequestFilterFunction _requestFilter;
+};
+
+#endif  // end JsonBodyWebHandler_h
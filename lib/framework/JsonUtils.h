@@ -5,6 +5,13 @@
 #include <IPUtils.h>
 #include <ArduinoJson.h>
 
+#include <memory>
+
+// Largest JSON document grown to when a service's state, or an update parsed for it, overflows a smaller one
+#ifndef MAX_JSON_DOCUMENT_SIZE
+#define MAX_JSON_DOCUMENT_SIZE 8192
+#endif
+
 class JsonUtils {
  public:
   static void readIP(JsonObject& root, const String& key, IPAddress& ip, const String& def) {
@@ -24,6 +31,77 @@ class JsonUtils {
       root[key] = ip.toString();
     }
   }
+
+  /**
+   * Applies a JSON merge patch (RFC 7396) to target. Members of the patch replace those in target, nested objects are
+   * merged recursively and members set to null are removed. Arrays are replaced whole.
+   */
+  static void mergePatch(JsonObject& target, JsonObject& patch) {
+    for (JsonPair kv : patch) {
+      const char* key = kv.key().c_str();
+      JsonVariant value = kv.value();
+      if (value.isNull()) {
+        target.remove(key);
+      } else if (value.is<JsonObject>()) {
+        JsonObject targetMember = target[key];
+        if (targetMember.isNull()) {
+          targetMember = target.createNestedObject(key);
+        }
+        JsonObject patchMember = value.as<JsonObject>();
+        mergePatch(targetMember, patchMember);
+      } else {
+        target[key] = value;
+      }
+    }
+  }
+
+  /**
+   * Parses JSON into a document sized for the input rather than a fixed buffer size. Parsing starts with a document
+   * of bufferSize, or of the input's length if that is larger, and is repeated in a document twice the size, up to
+   * MAX_JSON_DOCUMENT_SIZE, whenever it runs out of memory. The input is copied rather than parsed in place, so every
+   * attempt sees the original bytes. NoMemory therefore means the input is too large to parse, not that it is corrupt.
+   */
+  static DeserializationError readJson(std::unique_ptr<DynamicJsonDocument>& jsonDocument,
+                                       const char* input,
+                                       size_t length,
+                                       size_t bufferSize) {
+    return read(jsonDocument, input, length, bufferSize, [](JsonDocument& document, const char* data, size_t size) {
+      return deserializeJson(document, data, size);
+    });
+  }
+
+  // As readJson(), for MessagePack input
+  static DeserializationError readMsgPack(std::unique_ptr<DynamicJsonDocument>& jsonDocument,
+                                          const char* input,
+                                          size_t length,
+                                          size_t bufferSize) {
+    return read(jsonDocument, input, length, bufferSize, [](JsonDocument& document, const char* data, size_t size) {
+      return deserializeMsgPack(document, data, size);
+    });
+  }
+
+ private:
+  typedef DeserializationError (*Deserializer)(JsonDocument& document, const char* data, size_t size);
+
+  static DeserializationError read(std::unique_ptr<DynamicJsonDocument>& jsonDocument,
+                                   const char* input,
+                                   size_t length,
+                                   size_t bufferSize,
+                                   Deserializer deserializer) {
+    size_t capacity = length > bufferSize ? length : bufferSize;
+    if (capacity > MAX_JSON_DOCUMENT_SIZE) {
+      capacity = MAX_JSON_DOCUMENT_SIZE;
+    }
+    while (true) {
+      jsonDocument.reset(new DynamicJsonDocument(capacity));
+      DeserializationError error = deserializer(*jsonDocument, input, length);
+      if (error != DeserializationError::NoMemory || capacity >= MAX_JSON_DOCUMENT_SIZE ||
+          jsonDocument->capacity() == 0) {
+        return error;
+      }
+      capacity = capacity * 2 < MAX_JSON_DOCUMENT_SIZE ? capacity * 2 : MAX_JSON_DOCUMENT_SIZE;
+    }
+  }
 };
 
 #endif  // end JsonUtils
@@ -26,10 +26,10 @@ class MqttConnector {
   }
 };
 
-template <class T>
+template <class T, class StateReader = JsonStateReader<T>>
 class MqttPub : virtual public MqttConnector<T> {
  public:
-  MqttPub(JsonStateReader<T> stateReader,
+  MqttPub(StateReader stateReader,
           StatefulService<T>* statefulService,
           AsyncMqttClient* mqttClient,
           const String& pubTopic = "",
@@ -39,7 +39,16 @@ class MqttPub : virtual public MqttConnector<T> {
       _stateReader(stateReader),
       _pubTopic(pubTopic),
       _retain(retain) {
-    MqttConnector<T>::_statefulService->addUpdateHandler([&](const String& originId) { publish(); }, false);
+    MqttConnector<T>::_statefulService->addUpdateHandler(
+        [&](const String& originId, state_field_mask_t changedFields) { publish(changedFields); }, false);
+  }
+
+  /**
+   * Enables delta publishing. Once set, changes made by a delta updater publish only the changed fields. Retained
+   * messages always carry the full state, as a retained delta would leave new subscribers with a partial state.
+   */
+  void setDeltaReader(JsonStateDeltaReader<T> deltaReader) {
+    _deltaReader = deltaReader;
   }
 
   void setRetain(const bool retain) {
@@ -58,20 +67,23 @@ class MqttPub : virtual public MqttConnector<T> {
   }
 
  private:
-  JsonStateReader<T> _stateReader;
+  StateReader _stateReader;
+  JsonStateDeltaReader<T> _deltaReader;
   String _pubTopic;
   bool _retain;
 
-  void publish() {
+  void publish(state_field_mask_t fields = STATE_FIELDS_ALL) {
     if (_pubTopic.length() > 0 && MqttConnector<T>::_mqttClient->connected()) {
-      // serialize to json doc
-      DynamicJsonDocument json(MqttConnector<T>::_bufferSize);
-      JsonObject jsonObject = json.to<JsonObject>();
-      MqttConnector<T>::_statefulService->read(jsonObject, _stateReader);
-
-      // serialize to string
+      // serialize to string, sharing the cached payload unless sending a delta
       String payload;
-      serializeJson(json, payload);
+      if (_deltaReader && !_retain && fields != STATE_FIELDS_ALL) {
+        std::unique_ptr<DynamicJsonDocument> json = MqttConnector<T>::_statefulService->readDocument(
+            [&](T& settings, JsonObject& root) { _deltaReader(settings, root, fields); },
+            MqttConnector<T>::_bufferSize);
+        serializeJson(*json, payload);
+      } else {
+        payload = MqttConnector<T>::_statefulService->serialize(_stateReader, MqttConnector<T>::_bufferSize);
+      }
 
       // publish the payload
       MqttConnector<T>::_mqttClient->publish(_pubTopic.c_str(), 0, _retain, payload.c_str());
@@ -79,10 +91,10 @@ class MqttPub : virtual public MqttConnector<T> {
   }
 };
 
-template <class T>
+template <class T, class StateUpdater = JsonStateUpdater<T>>
 class MqttSub : virtual public MqttConnector<T> {
  public:
-  MqttSub(JsonStateUpdater<T> stateUpdater,
+  MqttSub(StateUpdater stateUpdater,
           StatefulService<T>* statefulService,
           AsyncMqttClient* mqttClient,
           const String& subTopic = "",
@@ -110,13 +122,19 @@ class MqttSub : virtual public MqttConnector<T> {
     }
   }
 
+  // Applies incoming messages with a delta updater, so changed fields are tracked for delta publishing
+  void setDeltaUpdater(JsonStateDeltaUpdater<T> deltaUpdater) {
+    _deltaUpdater = deltaUpdater;
+  }
+
  protected:
   virtual void onConnect() {
     subscribe();
   }
 
  private:
-  JsonStateUpdater<T> _stateUpdater;
+  StateUpdater _stateUpdater;
+  JsonStateDeltaUpdater<T> _deltaUpdater;
   String _subTopic;
 
   void subscribe() {
@@ -137,20 +155,24 @@ class MqttSub : virtual public MqttConnector<T> {
     }
 
     // deserialize from string
-    DynamicJsonDocument json(MqttConnector<T>::_bufferSize);
-    DeserializationError error = deserializeJson(json, payload, len);
-    if (!error && json.is<JsonObject>()) {
-      JsonObject jsonObject = json.as<JsonObject>();
-      MqttConnector<T>::_statefulService->update(jsonObject, _stateUpdater, MQTT_ORIGIN_ID);
+    std::unique_ptr<DynamicJsonDocument> json;
+    DeserializationError error = JsonUtils::readJson(json, payload, len, MqttConnector<T>::_bufferSize);
+    if (!error && json->is<JsonObject>()) {
+      JsonObject jsonObject = json->as<JsonObject>();
+      if (_deltaUpdater) {
+        MqttConnector<T>::_statefulService->update(jsonObject, _deltaUpdater, MQTT_ORIGIN_ID);
+      } else {
+        MqttConnector<T>::_statefulService->update(jsonObject, _stateUpdater, MQTT_ORIGIN_ID);
+      }
     }
   }
 };
 
-template <class T>
-class MqttPubSub : public MqttPub<T>, public MqttSub<T> {
+template <class T, class StateReader = JsonStateReader<T>, class StateUpdater = JsonStateUpdater<T>>
+class MqttPubSub : public MqttPub<T, StateReader>, public MqttSub<T, StateUpdater> {
  public:
-  MqttPubSub(JsonStateReader<T> stateReader,
-             JsonStateUpdater<T> stateUpdater,
+  MqttPubSub(StateReader stateReader,
+             StateUpdater stateUpdater,
              StatefulService<T>* statefulService,
              AsyncMqttClient* mqttClient,
              const String& pubTopic = "",
@@ -158,20 +180,20 @@ class MqttPubSub : public MqttPub<T>, public MqttSub<T> {
              bool retain = false,
              size_t bufferSize = DEFAULT_BUFFER_SIZE) :
       MqttConnector<T>(statefulService, mqttClient, bufferSize),
-      MqttPub<T>(stateReader, statefulService, mqttClient, pubTopic, retain, bufferSize),
-      MqttSub<T>(stateUpdater, statefulService, mqttClient, subTopic, bufferSize) {
+      MqttPub<T, StateReader>(stateReader, statefulService, mqttClient, pubTopic, retain, bufferSize),
+      MqttSub<T, StateUpdater>(stateUpdater, statefulService, mqttClient, subTopic, bufferSize) {
   }
 
  public:
   void configureTopics(const String& pubTopic, const String& subTopic) {
-    MqttSub<T>::setSubTopic(subTopic);
-    MqttPub<T>::setPubTopic(pubTopic);
+    MqttSub<T, StateUpdater>::setSubTopic(subTopic);
+    MqttPub<T, StateReader>::setPubTopic(pubTopic);
   }
 
  protected:
   void onConnect() {
-    MqttSub<T>::onConnect();
-    MqttPub<T>::onConnect();
+    MqttSub<T, StateUpdater>::onConnect();
+    MqttPub<T, StateReader>::onConnect();
   }
 };
 
@@ -21,8 +21,13 @@ static char* retainCstr(const char* cstr, char** ptr) {
 }
 
 MqttSettingsService::MqttSettingsService(AsyncWebServer* server, FS* fs, SecurityManager* securityManager) :
-    _httpEndpoint(MqttSettings::read, MqttSettings::update, this, server, MQTT_SETTINGS_SERVICE_PATH, securityManager),
-    _fsPersistence(MqttSettings::read, MqttSettings::update, this, fs, MQTT_SETTINGS_FILE),
+    _httpEndpoint(MqttSettingsReader(),
+                  MqttSettingsUpdater(),
+                  this,
+                  server,
+                  MQTT_SETTINGS_SERVICE_PATH,
+                  securityManager),
+    _fsPersistence(MqttSettingsReader(), MqttSettingsUpdater(), this, fs, MQTT_SETTINGS_FILE),
     _retainedHost(nullptr),
     _retainedClientId(nullptr),
     _retainedUsername(nullptr),
@@ -93,6 +93,9 @@ class MqttSettings {
   }
 };
 
+typedef StaticJsonStateReader<MqttSettings, MqttSettings::read> MqttSettingsReader;
+typedef StaticJsonStateUpdater<MqttSettings, MqttSettings::update> MqttSettingsUpdater;
+
 class MqttSettingsService : public StatefulService<MqttSettings> {
  public:
   MqttSettingsService(AsyncWebServer* server, FS* fs, SecurityManager* securityManager);
@@ -110,8 +113,8 @@ class MqttSettingsService : public StatefulService<MqttSettings> {
   void onConfigUpdated();
 
  private:
-  HttpEndpoint<MqttSettings> _httpEndpoint;
-  FSPersistence<MqttSettings> _fsPersistence;
+  HttpEndpoint<MqttSettings, MqttSettingsReader, MqttSettingsUpdater> _httpEndpoint;
+  FSPersistence<MqttSettings, MqttSettingsReader, MqttSettingsUpdater> _fsPersistence;
 
   // Pointers to hold retained copies of the mqtt client connection strings.
   // This is required as AsyncMqttClient holds refrences to the supplied connection strings.
@@ -3,7 +3,10 @@
 MqttStatus::MqttStatus(AsyncWebServer* server,
                        MqttSettingsService* mqttSettingsService,
                        SecurityManager* securityManager) :
-    _mqttSettingsService(mqttSettingsService) {
+    _mqttSettingsService(mqttSettingsService),
+    _statusCache(std::bind(&MqttStatus::readStatus, this, std::placeholders::_1),
+                 MAX_MQTT_STATUS_SIZE,
+                 MQTT_STATUS_CACHE_TTL) {
   server->on(MQTT_STATUS_SERVICE_PATH,
              HTTP_GET,
              securityManager->wrapRequest(std::bind(&MqttStatus::mqttStatus, this, std::placeholders::_1),
@@ -11,14 +14,12 @@ MqttStatus::MqttStatus(AsyncWebServer* server,
 }
 
 void MqttStatus::mqttStatus(AsyncWebServerRequest* request) {
-  AsyncJsonResponse* response = new AsyncJsonResponse(false, MAX_MQTT_STATUS_SIZE);
-  JsonObject root = response->getRoot();
+  request->send(200, JSON_MIMETYPE, _statusCache.serialize());
+}
 
+void MqttStatus::readStatus(JsonObject& root) {
   root["enabled"] = _mqttSettingsService->isEnabled();
   root["connected"] = _mqttSettingsService->isConnected();
   root["client_id"] = _mqttSettingsService->getClientId();
   root["disconnect_reason"] = (uint8_t)_mqttSettingsService->getDisconnectReason();
-
-  response->setLength();
-  request->send(response);
 }
@@ -13,19 +13,30 @@
 #include <ArduinoJson.h>
 #include <AsyncJson.h>
 #include <ESPAsyncWebServer.h>
+#include <StatusCache.h>
 #include <SecurityManager.h>
 
 #define MAX_MQTT_STATUS_SIZE 1024
+#ifndef MQTT_STATUS_CACHE_TTL
+#define MQTT_STATUS_CACHE_TTL DEFAULT_STATUS_CACHE_TTL
+#endif
 #define MQTT_STATUS_SERVICE_PATH "/rest/mqttStatus"
 
 class MqttStatus {
  public:
   MqttStatus(AsyncWebServer* server, MqttSettingsService* mqttSettingsService, SecurityManager* securityManager);
 
+  String serializeStatus() {
+    return _statusCache.serialize();
+  }
+
  private:
   MqttSettingsService* _mqttSettingsService;
 
+  StatusCache _statusCache;
+
   void mqttStatus(AsyncWebServerRequest* request);
+  void readStatus(JsonObject& root);
 };
 
 #endif  // end MqttStatus_h
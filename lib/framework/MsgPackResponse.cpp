@@ -0,0 +1,12 @@
+#include <MsgPackResponse.h>
+
+bool MsgPackResponse::accepted(AsyncWebServerRequest* request) {
+  const AsyncWebHeader* accept = request->getHeader(ACCEPT_HEADER);
+  return accept && accept->value().indexOf(MSGPACK_MIMETYPE) >= 0;
+}
+
+AsyncWebServerResponse* MsgPackResponse::begin(AsyncWebServerRequest* request, JsonDocument& jsonDocument) {
+  AsyncResponseStream* response = request->beginResponseStream(MSGPACK_MIMETYPE, measureMsgPack(jsonDocument));
+  serializeMsgPack(jsonDocument, *response);
+  return response;
+}
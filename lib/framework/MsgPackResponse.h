@@ -0,0 +1,23 @@
+#ifndef MsgPackResponse_h
+#define MsgPackResponse_h
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <ESPAsyncWebServer.h>
+
+#define MSGPACK_MIMETYPE "application/msgpack"
+#define ACCEPT_HEADER "Accept"
+
+/**
+ * Responses in MessagePack for clients which ask for it with "Accept: application/msgpack". The state is read with the
+ * same JSON readers, only the encoding differs, so machine clients get smaller bodies which are cheaper to parse.
+ */
+class MsgPackResponse {
+ public:
+  // Whether the client listed MessagePack in its Accept header
+  static bool accepted(AsyncWebServerRequest* request);
+
+  static AsyncWebServerResponse* begin(AsyncWebServerRequest* request, JsonDocument& jsonDocument);
+};
+
+#endif  // end MsgPackResponse_h
@@ -1,8 +1,8 @@
 #include <NTPSettingsService.h>
 
 NTPSettingsService::NTPSettingsService(AsyncWebServer* server, FS* fs, SecurityManager* securityManager) :
-    _httpEndpoint(NTPSettings::read, NTPSettings::update, this, server, NTP_SETTINGS_SERVICE_PATH, securityManager),
-    _fsPersistence(NTPSettings::read, NTPSettings::update, this, fs, NTP_SETTINGS_FILE),
+    _httpEndpoint(NTPSettingsReader(), NTPSettingsUpdater(), this, server, NTP_SETTINGS_SERVICE_PATH, securityManager),
+    _fsPersistence(NTPSettingsReader(), NTPSettingsUpdater(), this, fs, NTP_SETTINGS_FILE),
     _timeHandler(TIME_PATH,
                  securityManager->wrapCallback(
                      std::bind(&NTPSettingsService::configureTime, this, std::placeholders::_1, std::placeholders::_2),
@@ -56,6 +56,9 @@ class NTPSettings {
   }
 };
 
+typedef StaticJsonStateReader<NTPSettings, NTPSettings::read> NTPSettingsReader;
+typedef StaticJsonStateUpdater<NTPSettings, NTPSettings::update> NTPSettingsUpdater;
+
 class NTPSettingsService : public StatefulService<NTPSettings> {
  public:
   NTPSettingsService(AsyncWebServer* server, FS* fs, SecurityManager* securityManager);
@@ -63,8 +66,8 @@ class NTPSettingsService : public StatefulService<NTPSettings> {
   void begin();
 
  private:
-  HttpEndpoint<NTPSettings> _httpEndpoint;
-  FSPersistence<NTPSettings> _fsPersistence;
+  HttpEndpoint<NTPSettings, NTPSettingsReader, NTPSettingsUpdater> _httpEndpoint;
+  FSPersistence<NTPSettings, NTPSettingsReader, NTPSettingsUpdater> _fsPersistence;
   AsyncCallbackJsonWebHandler _timeHandler;
 
 #ifdef ESP32
@@ -1,6 +1,9 @@
 #include <NTPStatus.h>
 
-NTPStatus::NTPStatus(AsyncWebServer* server, SecurityManager* securityManager) {
+NTPStatus::NTPStatus(AsyncWebServer* server, SecurityManager* securityManager) :
+    _statusCache(std::bind(&NTPStatus::readStatus, this, std::placeholders::_1),
+                 MAX_NTP_STATUS_SIZE,
+                 NTP_STATUS_CACHE_TTL) {
   server->on(NTP_STATUS_SERVICE_PATH,
              HTTP_GET,
              securityManager->wrapRequest(std::bind(&NTPStatus::ntpStatus, this, std::placeholders::_1),
@@ -27,9 +30,10 @@ String toLocalTimeString(tm* time) {
 }
 
 void NTPStatus::ntpStatus(AsyncWebServerRequest* request) {
-  AsyncJsonResponse* response = new AsyncJsonResponse(false, MAX_NTP_STATUS_SIZE);
-  JsonObject root = response->getRoot();
+  request->send(200, JSON_MIMETYPE, _statusCache.serialize());
+}
 
+void NTPStatus::readStatus(JsonObject& root) {
   // grab the current instant in unix seconds
   time_t now = time(nullptr);
 
@@ -47,7 +51,4 @@ void NTPStatus::ntpStatus(AsyncWebServerRequest* request) {
 
   // device uptime in seconds
   root["uptime"] = millis() / 1000;
-
-  response->setLength();
-  request->send(response);
 }
@@ -15,17 +15,28 @@
 #include <ArduinoJson.h>
 #include <AsyncJson.h>
 #include <ESPAsyncWebServer.h>
+#include <StatusCache.h>
 #include <SecurityManager.h>
 
 #define MAX_NTP_STATUS_SIZE 1024
+#ifndef NTP_STATUS_CACHE_TTL
+#define NTP_STATUS_CACHE_TTL DEFAULT_STATUS_CACHE_TTL
+#endif
 #define NTP_STATUS_SERVICE_PATH "/rest/ntpStatus"
 
 class NTPStatus {
  public:
   NTPStatus(AsyncWebServer* server, SecurityManager* securityManager);
 
+  String serializeStatus() {
+    return _statusCache.serialize();
+  }
+
  private:
+  StatusCache _statusCache;
+
   void ntpStatus(AsyncWebServerRequest* request);
+  void readStatus(JsonObject& root);
 };
 
 #endif  // end NTPStatus_h
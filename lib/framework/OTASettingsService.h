@@ -48,6 +48,9 @@ class OTASettings {
   }
 };
 
+typedef StaticJsonStateReader<OTASettings, OTASettings::read> OTASettingsReader;
+typedef StaticJsonStateUpdater<OTASettings, OTASettings::update> OTASettingsUpdater;
+
 class OTASettingsService : public StatefulService<OTASettings> {
  public:
   OTASettingsService(AsyncWebServer* server, FS* fs, SecurityManager* securityManager);
@@ -56,8 +59,8 @@ class OTASettingsService : public StatefulService<OTASettings> {
   void loop();
 
  private:
-  HttpEndpoint<OTASettings> _httpEndpoint;
-  FSPersistence<OTASettings> _fsPersistence;
+  HttpEndpoint<OTASettings, OTASettingsReader, OTASettingsUpdater> _httpEndpoint;
+  FSPersistence<OTASettings, OTASettingsReader, OTASettingsUpdater> _fsPersistence;
   ArduinoOTAClass* _arduinoOTA;
 
   void configureArduinoOTA();
@@ -0,0 +1,115 @@
+#include <RequestGovernor.h>
+
+std::vector<RequestGovernor::AdmittedRequest_t> RequestGovernor::_admitted;
+std::vector<RequestGovernor::AdmittedRequest_t> RequestGovernor::_expired;
+uint32_t RequestGovernor::_shedBusy = 0;
+uint32_t RequestGovernor::_shedLowHeap = 0;
+
+bool RequestGovernor::admit(AsyncWebServerRequest* request) {
+  if (!reserve(request)) {
+    refuse(request);
+    return false;
+  }
+  return true;
+}
+
+bool RequestGovernor::reserve(AsyncWebServerRequest* request) {
+  expire();
+  if (isAdmitted(request)) {
+    return true;
+  }
+  if (_admitted.size() >= REQUEST_GOVERNOR_MAX_CONCURRENT) {
+    _shedBusy++;
+    return false;
+  }
+  if (ESP.getFreeHeap() < REQUEST_GOVERNOR_MIN_FREE_HEAP) {
+    _shedLowHeap++;
+    return false;
+  }
+  // an expired entry for this address belongs to this request, admitted again before registering any handler, or to
+  // a destroyed one which was never released
+  for (auto i = _expired.begin(); i != _expired.end(); i++) {
+    if (i->request == request) {
+      _expired.erase(i);
+      break;
+    }
+  }
+  _admitted.push_back({request, nullptr, millis()});
+  request->onDisconnect([request]() { RequestGovernor::release(request); });
+  return true;
+}
+
+bool RequestGovernor::isAdmitted(AsyncWebServerRequest* request) {
+  for (AdmittedRequest_t& admitted : _admitted) {
+    if (admitted.request == request) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void RequestGovernor::onDisconnect(AsyncWebServerRequest* request, ArDisconnectHandler onDisconnect) {
+  AdmittedRequest_t* admitted = find(request);
+  if (admitted) {
+    admitted->onDisconnect = onDisconnect;
+    return;
+  }
+  request->onDisconnect(onDisconnect);
+}
+
+void RequestGovernor::refuse(AsyncWebServerRequest* request) {
+  AsyncWebServerResponse* response = request->beginResponse(503);
+  response->addHeader(RETRY_AFTER_HEADER, String(REQUEST_GOVERNOR_RETRY_AFTER));
+  request->send(response);
+}
+
+// Expired requests are searched too, the governor's disconnect handler is still attached to them
+RequestGovernor::AdmittedRequest_t* RequestGovernor::find(AsyncWebServerRequest* request) {
+  for (AdmittedRequest_t& admitted : _admitted) {
+    if (admitted.request == request) {
+      return &admitted;
+    }
+  }
+  for (AdmittedRequest_t& expired : _expired) {
+    if (expired.request == request) {
+      return &expired;
+    }
+  }
+  return nullptr;
+}
+
+void RequestGovernor::release(AsyncWebServerRequest* request) {
+  for (std::vector<AdmittedRequest_t>* requests : {&_admitted, &_expired}) {
+    for (auto i = requests->begin(); i != requests->end(); i++) {
+      if (i->request == request) {
+        ArDisconnectHandler onDisconnect = i->onDisconnect;
+        requests->erase(i);
+        if (onDisconnect) {
+          onDisconnect();
+        }
+        return;
+      }
+    }
+  }
+}
+
+// A place still held after REQUEST_GOVERNOR_MAX_AGE is either a slow client or was leaked by a handler which replaced
+// the request's disconnect handler. It stops counting, but the request is kept so its handler runs if it disconnects.
+void RequestGovernor::expire() {
+  unsigned long now = millis();
+  for (auto i = _admitted.begin(); i != _admitted.end();) {
+    if (now - i->admittedAt >= REQUEST_GOVERNOR_MAX_AGE) {
+      Serial.printf("[Governor] Request held its place for over %d ms, no longer counting it\n",
+                    REQUEST_GOVERNOR_MAX_AGE);
+      _expired.push_back(*i);
+      i = _admitted.erase(i);
+    } else {
+      i++;
+    }
+  }
+  if (_expired.size() > REQUEST_GOVERNOR_MAX_EXPIRED) {
+    Serial.printf("[Governor] Forgetting %u expired requests\n",
+                  (unsigned)(_expired.size() - REQUEST_GOVERNOR_MAX_EXPIRED));
+    _expired.erase(_expired.begin(), _expired.end() - REQUEST_GOVERNOR_MAX_EXPIRED);
+  }
+}
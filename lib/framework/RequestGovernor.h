@@ -0,0 +1,107 @@
+#ifndef RequestGovernor_h
+#define RequestGovernor_h
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+#include <vector>
+
+// The most requests which may hold a response (and its JSON document or body buffer) at once
+#ifndef REQUEST_GOVERNOR_MAX_CONCURRENT
+#define REQUEST_GOVERNOR_MAX_CONCURRENT 4
+#endif
+
+// Requests are refused while the free heap is below this many bytes
+#ifndef REQUEST_GOVERNOR_MIN_FREE_HEAP
+#define REQUEST_GOVERNOR_MIN_FREE_HEAP 12288
+#endif
+
+// Seconds a refused client is asked to wait before retrying
+#ifndef REQUEST_GOVERNOR_RETRY_AFTER
+#define REQUEST_GOVERNOR_RETRY_AFTER 1
+#endif
+
+// Milliseconds after which an admitted request which was never released stops holding its place
+#ifndef REQUEST_GOVERNOR_MAX_AGE
+#define REQUEST_GOVERNOR_MAX_AGE 15000
+#endif
+
+// Expired requests kept waiting for their disconnect, beyond which the oldest are forgotten
+#ifndef REQUEST_GOVERNOR_MAX_EXPIRED
+#define REQUEST_GOVERNOR_MAX_EXPIRED 8
+#endif
+
+#define RETRY_AFTER_HEADER "Retry-After"
+
+/**
+ * Limits how many handled requests may be in flight at once, and refuses new ones while the heap is low, so a burst of
+ * clients is answered with 503 rather than exhausting the heap and resetting the device. SecurityManager::wrapRequest
+ * and wrapCallback admit every request they pass on; a request holds its place until the client disconnects, which is
+ * when its response has been freed. JsonBodyWebHandler reserves the place before buffering the body, so a refused body
+ * is never allocated.
+ *
+ * The governor keeps the request's disconnect handler for itself. Handlers of admitted requests must register their
+ * own with RequestGovernor::onDisconnect, which runs it once the place is released. A handler which replaces the
+ * request's disconnect handler anyway leaks the place, so a place held for longer than REQUEST_GOVERNOR_MAX_AGE stops
+ * counting as in flight. The request stays registered, so a slow client that disconnects later still runs its
+ * handler. Only the oldest expired requests beyond REQUEST_GOVERNOR_MAX_EXPIRED are forgotten, as by then they are
+ * almost certainly leaked.
+ */
+class RequestGovernor {
+ public:
+  /*
+   * Admit the request, or respond with 503 and return false
+   */
+  static bool admit(AsyncWebServerRequest* request);
+
+  /*
+   * Admit the request without responding if it is refused, which is left to the caller (see refuse). Admitting a
+   * request which already holds a place always succeeds.
+   */
+  static bool reserve(AsyncWebServerRequest* request);
+
+  /*
+   * Respond with 503 and Retry-After
+   */
+  static void refuse(AsyncWebServerRequest* request);
+
+  static bool isAdmitted(AsyncWebServerRequest* request);
+
+  /*
+   * Register a disconnect handler, which works whether or not the request was admitted by the governor
+   */
+  static void onDisconnect(AsyncWebServerRequest* request, ArDisconnectHandler onDisconnect);
+
+  static size_t getInFlight() {
+    return _admitted.size();
+  }
+
+  // Requests refused because REQUEST_GOVERNOR_MAX_CONCURRENT were already in flight
+  static uint32_t getShedBusy() {
+    return _shedBusy;
+  }
+
+  // Requests refused because the free heap was below REQUEST_GOVERNOR_MIN_FREE_HEAP
+  static uint32_t getShedLowHeap() {
+    return _shedLowHeap;
+  }
+
+ private:
+  typedef struct AdmittedRequest {
+    AsyncWebServerRequest* request;
+    ArDisconnectHandler onDisconnect;
+    unsigned long admittedAt;
+  } AdmittedRequest_t;
+
+  static std::vector<AdmittedRequest_t> _admitted;
+  // admitted requests which outlived REQUEST_GOVERNOR_MAX_AGE, no longer counted but still released on disconnect
+  static std::vector<AdmittedRequest_t> _expired;
+  static uint32_t _shedBusy;
+  static uint32_t _shedLowHeap;
+
+  static void expire();
+  static void release(AsyncWebServerRequest* request);
+  static AdmittedRequest_t* find(AsyncWebServerRequest* request);
+};
+
+#endif  // end RequestGovernor_h
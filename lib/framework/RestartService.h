@@ -10,6 +10,7 @@
 #endif
 
 #include <ESPAsyncWebServer.h>
+#include <FSPersistence.h>
 #include <SecurityManager.h>
 
 #define RESTART_SERVICE_PATH "/rest/restart"
@@ -19,6 +20,7 @@ class RestartService {
   RestartService(AsyncWebServer* server, SecurityManager* securityManager);
 
   static void restartNow() {
+    FSPersistenceBase::flushAll();
     WiFi.disconnect(true);
     delay(500);
     ESP.restart();
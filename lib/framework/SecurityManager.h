@@ -5,6 +5,7 @@
 #include <ArduinoJsonJWT.h>
 #include <ESPAsyncWebServer.h>
 #include <AsyncJson.h>
+#include <RequestGovernor.h>
 #include <list>
 
 #define ACCESS_TOKEN_PARAMATER "access_token"
@@ -84,7 +85,8 @@ class SecurityManager {
   virtual ArRequestFilterFunction filterRequest(AuthenticationPredicate predicate) = 0;
 
   /**
-   * Wrap the provided request to provide validation against an AuthenticationPredicate.
+   * Wrap the provided request to provide validation against an AuthenticationPredicate, admitting it through the
+   * RequestGovernor.
    */
   virtual ArRequestHandlerFunction wrapRequest(ArRequestHandlerFunction onRequest,
                                                AuthenticationPredicate predicate) = 0;
@@ -3,8 +3,8 @@
 #if FT_ENABLED(FT_SECURITY)
 
 SecuritySettingsService::SecuritySettingsService(AsyncWebServer* server, FS* fs) :
-    _httpEndpoint(SecuritySettings::read, SecuritySettings::update, this, server, SECURITY_SETTINGS_PATH, this),
-    _fsPersistence(SecuritySettings::read, SecuritySettings::update, this, fs, SECURITY_SETTINGS_FILE),
+    _httpEndpoint(SecuritySettingsReader(), SecuritySettingsUpdater(), this, server, SECURITY_SETTINGS_PATH, this),
+    _fsPersistence(SecuritySettingsReader(), SecuritySettingsUpdater(), this, fs, SECURITY_SETTINGS_FILE),
     _jwtHandler(FACTORY_JWT_SECRET) {
   addUpdateHandler([&](const String& originId) { configureJWTHandler(); }, false);
 }
@@ -92,6 +92,9 @@ ArRequestHandlerFunction SecuritySettingsService::wrapRequest(ArRequestHandlerFu
       request->send(401);
       return;
     }
+    if (!RequestGovernor::admit(request)) {
+      return;
+    }
     onRequest(request);
   };
 }
@@ -104,6 +107,9 @@ ArJsonRequestHandlerFunction SecuritySettingsService::wrapCallback(ArJsonRequest
       request->send(401);
       return;
     }
+    if (!RequestGovernor::admit(request)) {
+      return;
+    }
     onRequest(request, json);
   };
 }
@@ -126,15 +132,25 @@ Authentication SecuritySettingsService::authenticateRequest(AsyncWebServerReques
   return Authentication(ADMIN_USER);
 }
 
-// Return the function unwrapped
+// Return the function wrapped only by the request governor
 ArRequestHandlerFunction SecuritySettingsService::wrapRequest(ArRequestHandlerFunction onRequest,
                                                               AuthenticationPredicate predicate) {
-  return onRequest;
+  return [onRequest](AsyncWebServerRequest* request) {
+    if (!RequestGovernor::admit(request)) {
+      return;
+    }
+    onRequest(request);
+  };
 }
 
 ArJsonRequestHandlerFunction SecuritySettingsService::wrapCallback(ArJsonRequestHandlerFunction onRequest,
                                                                    AuthenticationPredicate predicate) {
-  return onRequest;
+  return [onRequest](AsyncWebServerRequest* request, JsonVariant& json) {
+    if (!RequestGovernor::admit(request)) {
+      return;
+    }
+    onRequest(request, json);
+  };
 }
 
 #endif
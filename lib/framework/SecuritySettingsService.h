@@ -70,6 +70,9 @@ class SecuritySettings {
   }
 };
 
+typedef StaticJsonStateReader<SecuritySettings, SecuritySettings::read> SecuritySettingsReader;
+typedef StaticJsonStateUpdater<SecuritySettings, SecuritySettings::update> SecuritySettingsUpdater;
+
 class SecuritySettingsService : public StatefulService<SecuritySettings>, public SecurityManager {
  public:
   SecuritySettingsService(AsyncWebServer* server, FS* fs);
@@ -85,8 +88,8 @@ class SecuritySettingsService : public StatefulService<SecuritySettings>, public
   ArJsonRequestHandlerFunction wrapCallback(ArJsonRequestHandlerFunction callback, AuthenticationPredicate predicate);
 
  private:
-  HttpEndpoint<SecuritySettings> _httpEndpoint;
-  FSPersistence<SecuritySettings> _fsPersistence;
+  HttpEndpoint<SecuritySettings, SecuritySettingsReader, SecuritySettingsUpdater> _httpEndpoint;
+  FSPersistence<SecuritySettings, SecuritySettingsReader, SecuritySettingsUpdater> _fsPersistence;
   ArduinoJsonJWT _jwtHandler;
 
   void configureJWTHandler();
@@ -0,0 +1,77 @@
+#include <StateUpdateDispatcher.h>
+
+StateUpdateDispatcher::StateUpdateDispatcher(size_t queueLength, uint32_t stackSize, uint8_t priority) :
+    _queueLength(queueLength),
+    _stackSize(stackSize),
+    _priority(priority),
+    _dispatchedCount(0),
+    _inlineCount(0),
+    _overflowCount(0),
+    _maxQueueMicros(0)
+#ifdef ESP32
+    ,_queue(nullptr),
+    _worker(nullptr)
+#endif
+{
+}
+
+void StateUpdateDispatcher::begin() {
+#ifdef ESP32
+  if (_queue) {
+    return;
+  }
+  _queue = xQueueCreate(_queueLength, sizeof(DispatchItem_t));
+  if (!_queue) {
+    Serial.println(F("[Dispatcher] Failed to create queue, update handlers will run inline"));
+    return;
+  }
+  if (xTaskCreate(StateUpdateDispatcher::workerTask, "updateDispatcher", _stackSize, this, _priority, &_worker) !=
+      pdPASS) {
+    Serial.println(F("[Dispatcher] Failed to create worker task, update handlers will run inline"));
+    vQueueDelete(_queue);
+    _queue = nullptr;
+  }
+#endif
+}
+
+void StateUpdateDispatcher::dispatch(UpdateDispatchFunction function, void* context) {
+#ifdef ESP32
+  if (_queue) {
+    DispatchItem_t item;
+    item.function = function;
+    item.context = context;
+    item.queuedAt = micros();
+    // the worker can't wait for itself to make room
+    bool onWorker = xTaskGetCurrentTaskHandle() == _worker;
+    if (xQueueSend(_queue, &item, onWorker ? 0 : portMAX_DELAY) == pdTRUE) {
+      return;
+    }
+    _overflowCount++;
+    function(context);
+    return;
+  }
+#endif
+  _inlineCount++;
+  function(context);
+}
+
+#ifdef ESP32
+void StateUpdateDispatcher::workerTask(void* dispatcher) {
+  static_cast<StateUpdateDispatcher*>(dispatcher)->runWorker();
+}
+
+void StateUpdateDispatcher::runWorker() {
+  DispatchItem_t item;
+  for (;;) {
+    if (xQueueReceive(_queue, &item, portMAX_DELAY) != pdTRUE) {
+      continue;
+    }
+    uint32_t queueMicros = micros() - item.queuedAt;
+    if (queueMicros > _maxQueueMicros) {
+      _maxQueueMicros = queueMicros;
+    }
+    item.function(item.context);
+    _dispatchedCount++;
+  }
+}
+#endif
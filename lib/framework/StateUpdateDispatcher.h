@@ -0,0 +1,92 @@
+#ifndef StateUpdateDispatcher_h
+#define StateUpdateDispatcher_h
+
+#include <Arduino.h>
+
+#ifdef ESP32
+#include <freertos/FreeRTOS.h>
+#include <freertos/queue.h>
+#include <freertos/task.h>
+#endif
+
+// Services with a propagation pending, each service queues at most once
+#ifndef UPDATE_DISPATCHER_QUEUE_LENGTH
+#define UPDATE_DISPATCHER_QUEUE_LENGTH 16
+#endif
+
+#ifndef UPDATE_DISPATCHER_STACK_SIZE
+#define UPDATE_DISPATCHER_STACK_SIZE 4096
+#endif
+
+#ifndef UPDATE_DISPATCHER_PRIORITY
+#define UPDATE_DISPATCHER_PRIORITY 1
+#endif
+
+typedef void (*UpdateDispatchFunction)(void* context);
+
+/**
+ * Runs update handler propagation on a dedicated worker task so the task which changed the state (AsyncTCP, the BLE
+ * stack or the MQTT client) is not held up by slow handlers such as file system persistence.
+ *
+ * The queue holds the services with a propagation pending, not the propagations themselves: a service queues itself
+ * at most once and folds later changes (and their changed fields) into the pending propagation, which the worker
+ * collects when it runs it. The queue therefore needs one entry per service using the dispatcher, dispatching never
+ * allocates and no change is ever dropped. If the queue is full anyway, callers wait for room, except the worker
+ * itself which runs the propagation in place. Until the dispatcher has been started, and always on ESP8266 which has
+ * no worker tasks, propagations run inline on the calling task.
+ */
+class StateUpdateDispatcher {
+ public:
+  StateUpdateDispatcher(size_t queueLength = UPDATE_DISPATCHER_QUEUE_LENGTH,
+                        uint32_t stackSize = UPDATE_DISPATCHER_STACK_SIZE,
+                        uint8_t priority = UPDATE_DISPATCHER_PRIORITY);
+
+  void begin();
+
+  // Runs function(context) on the worker task, the caller ensures each context is queued at most once
+  void dispatch(UpdateDispatchFunction function, void* context);
+
+  // Number of propagations run on the worker task
+  uint32_t getDispatchedCount() {
+    return _dispatchedCount;
+  }
+
+  // Number of propagations run inline because the dispatcher was not started
+  uint32_t getInlineCount() {
+    return _inlineCount;
+  }
+
+  // Number of propagations the worker ran in place because the queue was full
+  uint32_t getOverflowCount() {
+    return _overflowCount;
+  }
+
+  // Longest time a propagation spent waiting in the queue, in microseconds
+  uint32_t getMaxQueueMicros() {
+    return _maxQueueMicros;
+  }
+
+ private:
+  size_t _queueLength;
+  uint32_t _stackSize;
+  uint8_t _priority;
+  uint32_t _dispatchedCount;
+  uint32_t _inlineCount;
+  uint32_t _overflowCount;
+  uint32_t _maxQueueMicros;
+#ifdef ESP32
+  QueueHandle_t _queue;
+  TaskHandle_t _worker;
+
+  typedef struct DispatchItem {
+    UpdateDispatchFunction function;
+    void* context;
+    unsigned long queuedAt;
+  } DispatchItem_t;
+
+  static void workerTask(void* dispatcher);
+  void runWorker();
+#endif
+};
+
+#endif  // end StateUpdateDispatcher_h
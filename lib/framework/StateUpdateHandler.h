@@ -0,0 +1,141 @@
+#ifndef StateUpdateHandler_h
+#define StateUpdateHandler_h
+
+#include <Arduino.h>
+
+#include <new>
+#include <functional>
+#include <type_traits>
+
+// Bytes available to store a handler's captures without touching the heap, enough for a captured this pointer or a
+// std::function on both 32 and 64 bit targets
+#ifndef UPDATE_HANDLER_INLINE_SIZE
+#define UPDATE_HANDLER_INLINE_SIZE (4 * sizeof(void*))
+#endif
+
+// A set of numbered state fields, see StatefulService
+typedef uint32_t state_field_mask_t;
+
+/**
+ * A callable with the signature void(const String& originId), or void(const String& originId, state_field_mask_t
+ * changedFields) for handlers which only need to act on the fields a propagation changed, stored inline in a fixed
+ * size buffer. The changed fields are passed with each call rather than read back from the service, so propagations
+ * delivered concurrently each see their own.
+ *
+ * Unlike std::function, which may allocate for its target, a StateUpdateHandler never allocates. Callables which do
+ * not fit in UPDATE_HANDLER_INLINE_SIZE are rejected at compile time.
+ */
+class StateUpdateHandler {
+ public:
+  StateUpdateHandler() : _ops(nullptr) {
+  }
+
+  template <typename F,
+            typename = typename std::enable_if<
+                !std::is_same<typename std::decay<F>::type, StateUpdateHandler>::value>::type>
+  StateUpdateHandler(F&& callable) : _ops(nullptr) {
+    typedef typename std::decay<F>::type Callable;
+    static_assert(sizeof(Callable) <= UPDATE_HANDLER_INLINE_SIZE,
+                  "Update handler captures too much state, capture a pointer instead");
+    static_assert(alignof(Callable) <= alignof(Storage), "Update handler is over-aligned");
+    if (!isEmpty(callable)) {
+      new (&_storage) Callable(std::forward<F>(callable));
+      _ops = &Ops<Callable>::table;
+    }
+  }
+
+  StateUpdateHandler(const StateUpdateHandler& other) : _ops(other._ops) {
+    if (_ops) {
+      _ops->copy(&_storage, &other._storage);
+    }
+  }
+
+  StateUpdateHandler& operator=(const StateUpdateHandler& other) {
+    if (this != &other) {
+      reset();
+      if (other._ops) {
+        other._ops->copy(&_storage, &other._storage);
+        _ops = other._ops;
+      }
+    }
+    return *this;
+  }
+
+  ~StateUpdateHandler() {
+    reset();
+  }
+
+  void operator()(const String& originId, state_field_mask_t changedFields) const {
+    _ops->invoke(&_storage, originId, changedFields);
+  }
+
+  explicit operator bool() const {
+    return _ops != nullptr;
+  }
+
+ private:
+  typedef typename std::aligned_storage<UPDATE_HANDLER_INLINE_SIZE, alignof(void*)>::type Storage;
+
+  typedef struct HandlerOps {
+    void (*invoke)(const void* storage, const String& originId, state_field_mask_t changedFields);
+    void (*copy)(void* storage, const void* source);
+    void (*destroy)(void* storage);
+  } HandlerOps_t;
+
+  template <typename Callable>
+  struct Ops {
+    static void invoke(const void* storage, const String& originId, state_field_mask_t changedFields) {
+      call(*const_cast<Callable*>(static_cast<const Callable*>(storage)), originId, changedFields, 0);
+    }
+    // Preferred when the callable accepts the changed fields
+    template <typename C>
+    static auto call(C& callable, const String& originId, state_field_mask_t changedFields, int)
+        -> decltype(callable(originId, changedFields), void()) {
+      callable(originId, changedFields);
+    }
+    template <typename C>
+    static void call(C& callable, const String& originId, state_field_mask_t changedFields, long) {
+      callable(originId);
+    }
+    static void copy(void* storage, const void* source) {
+      new (storage) Callable(*static_cast<const Callable*>(source));
+    }
+    static void destroy(void* storage) {
+      static_cast<Callable*>(storage)->~Callable();
+    }
+    static const HandlerOps_t table;
+  };
+
+  Storage _storage;
+  const HandlerOps_t* _ops;
+
+  void reset() {
+    if (_ops) {
+      _ops->destroy(&_storage);
+      _ops = nullptr;
+    }
+  }
+
+  template <typename F>
+  static bool isEmpty(const F&) {
+    return false;
+  }
+
+  template <typename F>
+  static bool isEmpty(const std::function<F>& callable) {
+    return !callable;
+  }
+
+  template <typename F>
+  static bool isEmpty(F* callable) {
+    return !callable;
+  }
+};
+
+template <typename Callable>
+const StateUpdateHandler::HandlerOps_t StateUpdateHandler::Ops<Callable>::table = {
+    StateUpdateHandler::Ops<Callable>::invoke,
+    StateUpdateHandler::Ops<Callable>::copy,
+    StateUpdateHandler::Ops<Callable>::destroy};
+
+#endif  // end StateUpdateHandler_h
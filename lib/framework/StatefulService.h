@@ -3,9 +3,13 @@
 
 #include <Arduino.h>
 #include <ArduinoJson.h>
+#include <JsonUtils.h>
+#include <StateUpdateDispatcher.h>
+#include <StateUpdateHandler.h>
 
-#include <list>
+#include <memory>
 #include <functional>
+#include <type_traits>
 #ifdef ESP32
 #include <freertos/FreeRTOS.h>
 #include <freertos/semphr.h>
@@ -15,66 +19,315 @@
 #define DEFAULT_BUFFER_SIZE 1024
 #endif
 
+// Update handlers a service can hold, override per state type with a StateUpdateHandlerCapacity specialization
+#ifndef DEFAULT_UPDATE_HANDLER_CAPACITY
+#define DEFAULT_UPDATE_HANDLER_CAPACITY 8
+#endif
+
+// Serialized representations cached per service, see StatefulService::serialize
+#ifndef STATE_PAYLOAD_CACHE_SIZE
+#define STATE_PAYLOAD_CACHE_SIZE 2
+#endif
+
+// Origin reported when updates from more than one origin are coalesced into a single propagation
+#define COALESCED_ORIGIN_ID "coalesced"
+
 enum class StateUpdateResult {
   CHANGED = 0,  // The update changed the state and propagation should take place if required
   UNCHANGED,    // The state was unchanged, propagation should not take place
   ERROR         // There was a problem updating the state, propagation should not take place
 };
 
+enum class StateReadMode {
+  LOCKED = 0,  // Readers take the access mutex, serializing against writers and each other
+  SNAPSHOT     // Readers use an immutable copy of the state, published after each update, and never block
+};
+
 template <typename T>
 using JsonStateUpdater = std::function<StateUpdateResult(JsonObject& root, T& settings)>;
 
+/**
+ * A std::function which also remembers the plain function it was created from, if any. That function identifies the
+ * representation the reader produces, allowing serialized output to be cached and shared between transports.
+ */
+template <typename T>
+class JsonStateReader : public std::function<void(T& settings, JsonObject& root)> {
+ public:
+  typedef void (*Function)(T& settings, JsonObject& root);
+
+  JsonStateReader() : _function(nullptr) {
+  }
+
+  JsonStateReader(Function function) :
+      std::function<void(T& settings, JsonObject& root)>(function), _function(function) {
+  }
+
+  template <typename F,
+            typename = typename std::enable_if<!std::is_same<typename std::decay<F>::type, JsonStateReader>::value &&
+                                               !std::is_convertible<F, Function>::value>::type>
+  JsonStateReader(F reader) : std::function<void(T& settings, JsonObject& root)>(reader), _function(nullptr) {
+  }
+
+  // The plain function this reader wraps, or nullptr if it wraps some other callable
+  Function function() const {
+    return _function;
+  }
+
+ private:
+  Function _function;
+};
+
+/**
+ * A reader and updater bound at compile time rather than held in a std::function. Transports templated on these call
+ * the function directly, so the compiler can inline it and no type-erased callable is stored per transport. The function
+ * is part of the type, so they are default constructed:
+ *
+ * typedef StaticJsonStateReader<MyState, MyState::read> MyStateReader;
+ * typedef StaticJsonStateUpdater<MyState, MyState::update> MyStateUpdater;
+ *
+ * HttpEndpoint<MyState, MyStateReader, MyStateUpdater> _httpEndpoint;
+ *
+ * _httpEndpoint(MyStateReader(), MyStateUpdater(), this, server, MY_STATE_PATH, securityManager)
+ */
+template <typename T, void (*Reader)(T& settings, JsonObject& root)>
+class StaticJsonStateReader {
+ public:
+  typedef void (*Function)(T& settings, JsonObject& root);
+
+  StaticJsonStateReader() {
+  }
+
+  void operator()(T& settings, JsonObject& root) const {
+    Reader(settings, root);
+  }
+
+  Function function() const {
+    return Reader;
+  }
+};
+
+template <typename T, StateUpdateResult (*Updater)(JsonObject& root, T& settings)>
+class StaticJsonStateUpdater {
+ public:
+  typedef StateUpdateResult (*Function)(JsonObject& root, T& settings);
+
+  StaticJsonStateUpdater() {
+  }
+
+  StateUpdateResult operator()(JsonObject& root, T& settings) const {
+    return Updater(root, settings);
+  }
+};
+
+/**
+ * State types may opt in to field level change tracking by numbering their fields and supplying a delta updater,
+ * which reports the fields it changed, and a delta reader, which writes only the requested fields. Transports use
+ * these to send just the changed fields rather than re-serializing the whole state. Update handlers receive the fields
+ * changed by each propagation, or STATE_FIELDS_ALL if the changes were not made by a delta updater.
+ */
+#define STATE_FIELD(index) ((state_field_mask_t)1 << (index))
+#define STATE_FIELDS_ALL ((state_field_mask_t)0xFFFFFFFF)
+
+template <typename T>
+using JsonStateDeltaUpdater =
+    std::function<StateUpdateResult(JsonObject& root, T& settings, state_field_mask_t& changedFields)>;
+
 template <typename T>
-using JsonStateReader = std::function<void(T& settings, JsonObject& root)>;
+using JsonStateDeltaReader = std::function<void(T& settings, JsonObject& root, state_field_mask_t fields)>;
 
 typedef size_t update_handler_id_t;
 typedef std::function<void(const String& originId)> StateUpdateCallback;
 
+typedef struct StateUpdateHandlerStats {
+  uint32_t calls;
+  uint32_t totalMicros;
+  uint32_t maxMicros;
+} StateUpdateHandlerStats_t;
+
 typedef struct StateUpdateHandlerInfo {
   static update_handler_id_t currentUpdatedHandlerId;
   update_handler_id_t _id;
-  StateUpdateCallback _cb;
+  StateUpdateHandler _cb;
   bool _allowRemove;
-  StateUpdateHandlerInfo(StateUpdateCallback cb, bool allowRemove) :
-      _id(++currentUpdatedHandlerId), _cb(cb), _allowRemove(allowRemove){};
+  StateUpdateHandlerStats_t _stats;
+  StateUpdateHandlerInfo() : _id(0), _allowRemove(false), _stats({0, 0, 0}){};
+  StateUpdateHandlerInfo(const StateUpdateHandler& cb, bool allowRemove) :
+      _id(++currentUpdatedHandlerId), _cb(cb), _allowRemove(allowRemove), _stats({0, 0, 0}){};
 } StateUpdateHandlerInfo_t;
 
+/**
+ * The number of update handlers a StatefulService<T> can hold. Handlers are kept in a fixed table inside the service
+ * so registration and dispatch never allocate. Specialize for state types which need more (or fewer) handlers:
+ *
+ * template <>
+ * struct StateUpdateHandlerCapacity<MyState> {
+ *   static const size_t value = 12;
+ * };
+ */
+template <class T>
+struct StateUpdateHandlerCapacity {
+  static const size_t value = DEFAULT_UPDATE_HANDLER_CAPACITY;
+};
+
+/**
+ * The JSON document capacity a StatefulService<T> starts with, in place of the transport's buffer size. Zero means
+ * unknown, the first read then uses the buffer size and the service learns the capacity from it. Specialize for state
+ * types with a fixed shape to size every document from the first read:
+ *
+ * template <>
+ * struct StateJsonCapacity<MyState> {
+ *   static const size_t value = JSON_OBJECT_SIZE(2);
+ * };
+ */
+template <class T>
+struct StateJsonCapacity {
+  static const size_t value = 0;
+};
+
 template <class T>
 class StatefulService {
  public:
   template <typename... Args>
 #ifdef ESP32
   StatefulService(Args&&... args) :
-      _state(std::forward<Args>(args)...), _accessMutex(xSemaphoreCreateRecursiveMutex()) {
+      _state(std::forward<Args>(args)...),
+      _readMode(StateReadMode::LOCKED),
+      _revision(0),
+      _payloadCacheNext(0),
+      _payloadCacheHits(0),
+      _payloadCacheMisses(0),
+      _jsonCapacity(StateJsonCapacity<T>::value),
+      _jsonOverflowCount(0),
+      _propagationWindow(0),
+      _propagationPending(false),
+      _lastPropagation(0),
+      _propagationCount(0),
+      _coalescedUpdateCount(0),
+      _updateDispatcher(nullptr),
+      _dispatchPending(false),
+      _changedFields(0),
+      _accessMutex(xSemaphoreCreateRecursiveMutex()),
+      _payloadCacheMutex(xSemaphoreCreateMutex()),
+      _updateHandlersMutex(xSemaphoreCreateRecursiveMutex()),
+      _updateHandlerCount(0) {
   }
 #else
-  StatefulService(Args&&... args) : _state(std::forward<Args>(args)...) {
+  StatefulService(Args&&... args) :
+      _state(std::forward<Args>(args)...),
+      _readMode(StateReadMode::LOCKED),
+      _revision(0),
+      _payloadCacheNext(0),
+      _payloadCacheHits(0),
+      _payloadCacheMisses(0),
+      _jsonCapacity(StateJsonCapacity<T>::value),
+      _jsonOverflowCount(0),
+      _propagationWindow(0),
+      _propagationPending(false),
+      _lastPropagation(0),
+      _propagationCount(0),
+      _coalescedUpdateCount(0),
+      _updateDispatcher(nullptr),
+      _dispatchPending(false),
+      _changedFields(0),
+      _updateHandlerCount(0) {
   }
 #endif
 
-  update_handler_id_t addUpdateHandler(StateUpdateCallback cb, bool allowRemove = true) {
+  /**
+   * Selects how readers access the state. In SNAPSHOT mode a copy of the state is published after every update so
+   * readers (HTTP, WebSocket, MQTT, BLE, persistence) never wait on writers or each other, at the cost of one copy of T
+   * per update. Readers must treat the state as read-only in this mode.
+   */
+  void setReadMode(StateReadMode readMode) {
+    beginTransaction();
+    _readMode = readMode;
+    if (_readMode == StateReadMode::SNAPSHOT) {
+      publishSnapshot(_revision);
+    } else {
+      std::atomic_store(&_snapshot, std::shared_ptr<StateSnapshot_t>());
+    }
+    endTransaction();
+  }
+
+  StateReadMode getReadMode() {
+    return _readMode;
+  }
+
+  /**
+   * A counter incremented every time an update may have modified the state. Readers can compare revisions to tell
+   * whether the state has changed without locking or serializing it. To label serialized output with its revision use
+   * the revision reported by serialize() or readDocument(), which is the one actually read.
+   */
+  uint32_t getRevision() {
+    return _revision;
+  }
+
+  update_handler_id_t addUpdateHandler(StateUpdateHandler cb, bool allowRemove = true) {
     if (!cb) {
       return 0;
     }
-    StateUpdateHandlerInfo_t updateHandler(cb, allowRemove);
-    _updateHandlers.push_back(updateHandler);
-    return updateHandler._id;
+    lockUpdateHandlers();
+    if (_updateHandlerCount == StateUpdateHandlerCapacity<T>::value) {
+      unlockUpdateHandlers();
+      Serial.println(F("[StatefulService] Update handler capacity reached, handler not added"));
+      return 0;
+    }
+    StateUpdateHandlerInfo_t& updateHandler = _updateHandlers[_updateHandlerCount++];
+    updateHandler = StateUpdateHandlerInfo_t(cb, allowRemove);
+    update_handler_id_t id = updateHandler._id;
+    unlockUpdateHandlers();
+    return id;
   }
 
+  // Waits for a propagation in progress, so the removed handler is not called once this returns
   void removeUpdateHandler(update_handler_id_t id) {
-    for (auto i = _updateHandlers.begin(); i != _updateHandlers.end();) {
-      if ((*i)._allowRemove && (*i)._id == id) {
-        i = _updateHandlers.erase(i);
-      } else {
-        ++i;
+    lockUpdateHandlers();
+    size_t retained = 0;
+    for (size_t i = 0; i < _updateHandlerCount; i++) {
+      if (_updateHandlers[i]._allowRemove && _updateHandlers[i]._id == id) {
+        continue;
+      }
+      if (retained != i) {
+        _updateHandlers[retained] = _updateHandlers[i];
+      }
+      retained++;
+    }
+    while (_updateHandlerCount > retained) {
+      _updateHandlers[--_updateHandlerCount] = StateUpdateHandlerInfo_t();
+    }
+    unlockUpdateHandlers();
+  }
+
+  /**
+   * Copies the call count and execution time of the given update handler into stats, returning false if the handler
+   * is not registered.
+   */
+  bool getUpdateHandlerStats(update_handler_id_t id, StateUpdateHandlerStats_t& stats) {
+    lockUpdateHandlers();
+    for (size_t i = 0; i < _updateHandlerCount; i++) {
+      if (_updateHandlers[i]._id == id) {
+        stats = _updateHandlers[i]._stats;
+        unlockUpdateHandlers();
+        return true;
       }
     }
+    unlockUpdateHandlers();
+    return false;
+  }
+
+  /**
+   * Moves update handler execution onto the dispatcher's worker task, so the task which changed the state returns
+   * as soon as the change is applied. Changes made while a propagation is queued are folded into it, so each service
+   * has at most one propagation queued. Pass nullptr to run handlers inline again.
+   */
+  void setUpdateDispatcher(StateUpdateDispatcher* updateDispatcher) {
+    _updateDispatcher = updateDispatcher;
   }
 
   StateUpdateResult update(std::function<StateUpdateResult(T&)> stateUpdater, const String& originId) {
     beginTransaction();
     StateUpdateResult result = stateUpdater(_state);
-    endTransaction();
+    commitTransaction(result);
     if (result == StateUpdateResult::CHANGED) {
       callUpdateHandlers(originId);
     }
@@ -84,43 +337,239 @@ class StatefulService {
   StateUpdateResult updateWithoutPropagation(std::function<StateUpdateResult(T&)> stateUpdater) {
     beginTransaction();
     StateUpdateResult result = stateUpdater(_state);
-    endTransaction();
+    commitTransaction(result);
     return result;
   }
 
   StateUpdateResult update(JsonObject& jsonObject, JsonStateUpdater<T> stateUpdater, const String& originId) {
     beginTransaction();
     StateUpdateResult result = stateUpdater(jsonObject, _state);
-    endTransaction();
+    commitTransaction(result);
     if (result == StateUpdateResult::CHANGED) {
       callUpdateHandlers(originId);
     }
     return result;
   }
 
+  // As updateWithoutPropagation(stateUpdater), for updaters which report the fields they changed
+  StateUpdateResult updateWithoutPropagation(
+      std::function<StateUpdateResult(T& settings, state_field_mask_t& changedFields)> stateUpdater) {
+    state_field_mask_t changedFields = 0;
+    beginTransaction();
+    StateUpdateResult result = stateUpdater(_state, changedFields);
+    commitTransaction(result, changedFields);
+    return result;
+  }
+
   StateUpdateResult updateWithoutPropagation(JsonObject& jsonObject, JsonStateUpdater<T> stateUpdater) {
     beginTransaction();
     StateUpdateResult result = stateUpdater(jsonObject, _state);
-    endTransaction();
+    commitTransaction(result);
+    return result;
+  }
+
+  template <StateUpdateResult (*Updater)(JsonObject& root, T& settings)>
+  StateUpdateResult update(JsonObject& jsonObject,
+                           StaticJsonStateUpdater<T, Updater> stateUpdater,
+                           const String& originId) {
+    StateUpdateResult result = updateWithoutPropagation(jsonObject, stateUpdater);
+    if (result == StateUpdateResult::CHANGED) {
+      callUpdateHandlers(originId);
+    }
+    return result;
+  }
+
+  template <StateUpdateResult (*Updater)(JsonObject& root, T& settings)>
+  StateUpdateResult updateWithoutPropagation(JsonObject& jsonObject, StaticJsonStateUpdater<T, Updater> stateUpdater) {
+    beginTransaction();
+    StateUpdateResult result = stateUpdater(jsonObject, _state);
+    commitTransaction(result);
+    return result;
+  }
+
+  StateUpdateResult update(JsonObject& jsonObject, JsonStateDeltaUpdater<T> stateUpdater, const String& originId) {
+    StateUpdateResult result = updateWithoutPropagation(jsonObject, stateUpdater);
+    if (result == StateUpdateResult::CHANGED) {
+      callUpdateHandlers(originId);
+    }
+    return result;
+  }
+
+  StateUpdateResult updateWithoutPropagation(JsonObject& jsonObject, JsonStateDeltaUpdater<T> stateUpdater) {
+    state_field_mask_t changedFields = 0;
+    beginTransaction();
+    StateUpdateResult result = stateUpdater(jsonObject, _state, changedFields);
+    commitTransaction(result, changedFields);
     return result;
   }
 
   void read(std::function<void(T&)> stateReader) {
+    std::shared_ptr<StateSnapshot_t> snapshot = acquireSnapshot();
+    if (snapshot) {
+      stateReader(snapshot->state);
+      return;
+    }
     beginTransaction();
     stateReader(_state);
     endTransaction();
   }
 
-  void read(JsonObject& jsonObject, JsonStateReader<T> stateReader) {
+  template <typename StateReader>
+  void read(JsonObject& jsonObject, const StateReader& stateReader) {
+    readRevision(jsonObject, stateReader, nullptr);
+  }
+
+  void read(JsonObject& jsonObject, JsonStateDeltaReader<T> stateReader, state_field_mask_t fields) {
+    read(jsonObject, [&](T& settings, JsonObject& root) { stateReader(settings, root, fields); });
+  }
+
+  /**
+   * Serializes the state to JSON with the given reader. The output is cached against the current revision, so every
+   * transport using the same reader (HTTP, WebSocket, MQTT, BLE and persistence) shares a single serialization until
+   * the state next changes. Only readers created from a plain function are cached. If revision is given it receives the
+   * revision of the state serialized, to label the output with (as an ETag or event id).
+   */
+  String serialize(const JsonStateReader<T>& stateReader, size_t bufferSize, uint32_t* revision = nullptr) {
+    typename JsonStateReader<T>::Function function = stateReader.function();
+    if (!function) {
+      return serializeState(stateReader, bufferSize, revision);
+    }
+    return serializeCached(function, stateReader, bufferSize, revision);
+  }
+
+  template <void (*Reader)(T& settings, JsonObject& root)>
+  String serialize(StaticJsonStateReader<T, Reader> stateReader, size_t bufferSize, uint32_t* revision = nullptr) {
+    return serializeCached(Reader, stateReader, bufferSize, revision);
+  }
+
+  /**
+   * Reads the state into a JSON document sized from the largest document this service has needed so far rather than
+   * the fixed bufferSize. If the state no longer fits, the document is reallocated at twice the size (up to
+   * MAX_JSON_DOCUMENT_SIZE) and read again, so output is never silently truncated. Headroom is added to the capacity
+   * for callers which go on to modify the document. If revision is given it receives the revision of the state read.
+   */
+  template <typename StateReader>
+  std::unique_ptr<DynamicJsonDocument> readDocument(const StateReader& stateReader,
+                                                    size_t bufferSize,
+                                                    size_t headroom = 0,
+                                                    uint32_t* revision = nullptr) {
+    size_t capacity = (_jsonCapacity ? _jsonCapacity : bufferSize) + headroom;
+    while (true) {
+      std::unique_ptr<DynamicJsonDocument> jsonDocument(new DynamicJsonDocument(capacity));
+      JsonObject jsonObject = jsonDocument->to<JsonObject>();
+      readRevision(jsonObject, stateReader, revision);
+      if (!jsonDocument->overflowed()) {
+        // leave headroom so small changes to the state don't immediately overflow
+        size_t used = jsonDocument->memoryUsage();
+        if (used > _jsonCapacity) {
+          _jsonCapacity = used + used / 4;
+        }
+        return jsonDocument;
+      }
+      _jsonOverflowCount++;
+      if (capacity >= MAX_JSON_DOCUMENT_SIZE || jsonDocument->capacity() == 0) {
+        Serial.printf("[JSON] State truncated, %u bytes is not enough\n", (unsigned)capacity);
+        return jsonDocument;
+      }
+      capacity = capacity * 2 < MAX_JSON_DOCUMENT_SIZE ? capacity * 2 : MAX_JSON_DOCUMENT_SIZE;
+    }
+  }
+
+  // The capacity readDocument() will allocate next, zero until the state has been read
+  size_t getJsonCapacity() {
+    return _jsonCapacity;
+  }
+
+  // Number of reads which overflowed their document and had to be retried in a larger one
+  uint32_t getJsonOverflowCount() {
+    return _jsonOverflowCount;
+  }
+
+  // Number of serialize() calls answered from the payload cache
+  uint32_t getPayloadCacheHits() {
+    return _payloadCacheHits;
+  }
+
+  // Number of serialize() calls which had to serialize the state
+  uint32_t getPayloadCacheMisses() {
+    return _payloadCacheMisses;
+  }
+
+  /**
+   * Limits update handlers to at most one propagation per window. Changes arriving within the window after a
+   * propagation are collapsed into a single pending propagation (latest state wins, differing origins are reported as
+   * COALESCED_ORIGIN_ID) which is delivered by propagatePendingUpdates() once the window has elapsed. A window of zero,
+   * the default, propagates every change immediately.
+   */
+  void setPropagationWindow(uint32_t windowMs) {
     beginTransaction();
-    stateReader(_state, jsonObject);
+    _propagationWindow = windowMs;
     endTransaction();
+    if (!windowMs) {
+      propagatePendingUpdates();
+    }
+  }
+
+  uint32_t getPropagationWindow() {
+    return _propagationWindow;
+  }
+
+  /**
+   * Delivers a coalesced propagation if one is pending and the window has elapsed. Should be called regularly from the
+   * owning service's loop when a propagation window is configured.
+   */
+  void propagatePendingUpdates() {
+    if (!_propagationPending) {
+      return;
+    }
+    beginTransaction();
+    if (!_propagationPending || (_propagationWindow && millis() - _lastPropagation < _propagationWindow)) {
+      endTransaction();
+      return;
+    }
+    String originId = _pendingOriginId;
+    _propagationPending = false;
+    _lastPropagation = millis();
+    _propagationCount++;
+    endTransaction();
+    dispatchUpdateHandlers(originId);
+  }
+
+  // Number of times the update handlers have been called
+  uint32_t getPropagationCount() {
+    return _propagationCount;
+  }
+
+  // Number of changes folded into another propagation, pending or queued, rather than propagated on their own
+  uint32_t getCoalescedUpdateCount() {
+    return _coalescedUpdateCount;
   }
 
   void callUpdateHandlers(const String& originId) {
-    for (const StateUpdateHandlerInfo_t& updateHandler : _updateHandlers) {
-      updateHandler._cb(originId);
+    if (_propagationWindow) {
+      beginTransaction();
+      unsigned long now = millis();
+      if (_propagationPending) {
+        _coalescedUpdateCount++;
+        if (_pendingOriginId != originId) {
+          _pendingOriginId = COALESCED_ORIGIN_ID;
+        }
+        endTransaction();
+        return;
+      }
+      if (now - _lastPropagation < _propagationWindow) {
+        _propagationPending = true;
+        _pendingOriginId = originId;
+        endTransaction();
+        return;
+      }
+      _lastPropagation = now;
+      _propagationCount++;
+      endTransaction();
+    } else {
+      _propagationCount++;
     }
+    dispatchUpdateHandlers(originId);
   }
 
  protected:
@@ -138,11 +587,246 @@ class StatefulService {
 #endif
   }
 
+  // Ends an update transaction, publishing a fresh snapshot for lock-free readers if the state may have been modified
+  inline void commitTransaction(StateUpdateResult result, state_field_mask_t changedFields = STATE_FIELDS_ALL) {
+    if (result == StateUpdateResult::CHANGED) {
+      _changedFields |= changedFields ? changedFields : STATE_FIELDS_ALL;
+    }
+    if (result != StateUpdateResult::UNCHANGED) {
+      // publish first, so the revision never runs ahead of the state lock-free readers see
+      uint32_t revision = _revision + 1;
+      if (_readMode == StateReadMode::SNAPSHOT) {
+        publishSnapshot(revision);
+      }
+      _revision = revision;
+    }
+    endTransaction();
+  }
+
  private:
+  // A copy of the state published for lock-free readers, with the revision it was taken at
+  typedef struct StateSnapshot {
+    T state;
+    uint32_t revision;
+    StateSnapshot(const T& state, uint32_t revision) : state(state), revision(revision) {
+    }
+  } StateSnapshot_t;
+
+  StateReadMode _readMode;
+  std::shared_ptr<StateSnapshot_t> _snapshot;
+  volatile uint32_t _revision;
+
+  // Must be called within a transaction so the copy is consistent
+  void publishSnapshot(uint32_t revision) {
+    std::atomic_store(&_snapshot, std::make_shared<StateSnapshot_t>(_state, revision));
+  }
+
+  // Reads the state, from the snapshot if there is one, reporting the revision read if revision is given
+  template <typename StateReader>
+  void readRevision(JsonObject& jsonObject, const StateReader& stateReader, uint32_t* revision) {
+    std::shared_ptr<StateSnapshot_t> snapshot = acquireSnapshot();
+    if (snapshot) {
+      stateReader(snapshot->state, jsonObject);
+      if (revision) {
+        *revision = snapshot->revision;
+      }
+      return;
+    }
+    beginTransaction();
+    stateReader(_state, jsonObject);
+    if (revision) {
+      *revision = _revision;
+    }
+    endTransaction();
+  }
+
+  typedef struct StatePayloadCacheEntry {
+    typename JsonStateReader<T>::Function function;
+    uint32_t revision;
+    String payload;
+    StatePayloadCacheEntry() : function(nullptr), revision(0) {
+    }
+  } StatePayloadCacheEntry_t;
+
+  StatePayloadCacheEntry_t _payloadCache[STATE_PAYLOAD_CACHE_SIZE];
+  size_t _payloadCacheNext;
+  uint32_t _payloadCacheHits;
+  uint32_t _payloadCacheMisses;
+
+  size_t _jsonCapacity;
+  uint32_t _jsonOverflowCount;
+
+  /**
+   * Entries are keyed on the revision actually serialized, which may be newer than the one looked up, so a payload is
+   * never cached or returned under a revision it doesn't hold.
+   */
+  template <typename StateReader>
+  String serializeCached(typename JsonStateReader<T>::Function function,
+                         const StateReader& stateReader,
+                         size_t bufferSize,
+                         uint32_t* revisionRead) {
+    uint32_t revision = _revision;
+    lockPayloadCache();
+    for (size_t i = 0; i < STATE_PAYLOAD_CACHE_SIZE; i++) {
+      StatePayloadCacheEntry_t& entry = _payloadCache[i];
+      if (entry.function == function && entry.revision == revision) {
+        String payload = entry.payload;
+        _payloadCacheHits++;
+        unlockPayloadCache();
+        if (revisionRead) {
+          *revisionRead = revision;
+        }
+        return payload;
+      }
+    }
+    _payloadCacheMisses++;
+    unlockPayloadCache();
+
+    String payload = serializeState(stateReader, bufferSize, &revision);
+    if (revisionRead) {
+      *revisionRead = revision;
+    }
+
+    lockPayloadCache();
+    StatePayloadCacheEntry_t* slot = &_payloadCache[_payloadCacheNext];
+    for (size_t i = 0; i < STATE_PAYLOAD_CACHE_SIZE; i++) {
+      if (_payloadCache[i].function == function) {
+        slot = &_payloadCache[i];
+        break;
+      }
+    }
+    if (slot == &_payloadCache[_payloadCacheNext]) {
+      _payloadCacheNext = (_payloadCacheNext + 1) % STATE_PAYLOAD_CACHE_SIZE;
+    }
+    slot->function = function;
+    slot->revision = revision;
+    slot->payload = payload;
+    unlockPayloadCache();
+    return payload;
+  }
+
+  // The cache has its own lock so, in SNAPSHOT mode, cached reads never wait on a writer holding the access mutex
+  inline void lockPayloadCache() {
+#ifdef ESP32
+    xSemaphoreTake(_payloadCacheMutex, portMAX_DELAY);
+#endif
+  }
+
+  inline void unlockPayloadCache() {
+#ifdef ESP32
+    xSemaphoreGive(_payloadCacheMutex);
+#endif
+  }
+
+  template <typename StateReader>
+  String serializeState(const StateReader& stateReader, size_t bufferSize, uint32_t* revision) {
+    std::unique_ptr<DynamicJsonDocument> jsonDocument = readDocument(stateReader, bufferSize, 0, revision);
+    String payload;
+    serializeJson(*jsonDocument, payload);
+    return payload;
+  }
+
+  uint32_t _propagationWindow;
+  volatile bool _propagationPending;
+  String _pendingOriginId;
+  unsigned long _lastPropagation;
+  uint32_t _propagationCount;
+  uint32_t _coalescedUpdateCount;
+
+  StateUpdateDispatcher* _updateDispatcher;
+  bool _dispatchPending;
+  String _dispatchOriginId;
+
+  state_field_mask_t _changedFields;
+
+  void dispatchUpdateHandlers(const String& originId) {
+    beginTransaction();
+    if (_updateDispatcher) {
+      // fold the change into the propagation already queued, the worker collects its fields when it runs
+      if (_dispatchPending) {
+        _coalescedUpdateCount++;
+        if (_dispatchOriginId != originId) {
+          _dispatchOriginId = COALESCED_ORIGIN_ID;
+        }
+        endTransaction();
+        return;
+      }
+      _dispatchPending = true;
+      _dispatchOriginId = originId;
+      endTransaction();
+      _updateDispatcher->dispatch(StatefulService::dispatchedUpdateHandlers, this);
+      return;
+    }
+    state_field_mask_t changedFields = takeChangedFields();
+    endTransaction();
+    invokeUpdateHandlers(originId, changedFields);
+  }
+
+  static void dispatchedUpdateHandlers(void* context) {
+    StatefulService* statefulService = static_cast<StatefulService*>(context);
+    statefulService->beginTransaction();
+    String originId = statefulService->_dispatchOriginId;
+    state_field_mask_t changedFields = statefulService->takeChangedFields();
+    statefulService->_dispatchPending = false;
+    statefulService->endTransaction();
+    statefulService->invokeUpdateHandlers(originId, changedFields);
+  }
+
+  // Must be called within a transaction
+  state_field_mask_t takeChangedFields() {
+    state_field_mask_t changedFields = _changedFields ? _changedFields : STATE_FIELDS_ALL;
+    _changedFields = 0;
+    return changedFields;
+  }
+
+  void invokeUpdateHandlers(const String& originId, state_field_mask_t changedFields) {
+    lockUpdateHandlers();
+    for (size_t i = 0; i < _updateHandlerCount; i++) {
+      StateUpdateHandlerInfo_t& updateHandler = _updateHandlers[i];
+      unsigned long startedAt = micros();
+      updateHandler._cb(originId, changedFields);
+      uint32_t elapsed = micros() - startedAt;
+      updateHandler._stats.calls++;
+      updateHandler._stats.totalMicros += elapsed;
+      if (elapsed > updateHandler._stats.maxMicros) {
+        updateHandler._stats.maxMicros = elapsed;
+      }
+    }
+    unlockUpdateHandlers();
+  }
+
+  /**
+   * The handler table has its own lock, held while handlers run, so it may be changed from any task while the
+   * dispatcher's worker walks it. It is recursive as handlers may add or remove handlers, and separate from the access
+   * mutex so writers aren't held up by slow handlers. Handlers must not wait on another task which propagates changes
+   * to this service.
+   */
+  inline void lockUpdateHandlers() {
+#ifdef ESP32
+    xSemaphoreTakeRecursive(_updateHandlersMutex, portMAX_DELAY);
+#endif
+  }
+
+  inline void unlockUpdateHandlers() {
+#ifdef ESP32
+    xSemaphoreGiveRecursive(_updateHandlersMutex);
+#endif
+  }
+
+  std::shared_ptr<StateSnapshot_t> acquireSnapshot() {
+    if (_readMode != StateReadMode::SNAPSHOT) {
+      return std::shared_ptr<StateSnapshot_t>();
+    }
+    return std::atomic_load(&_snapshot);
+  }
+
 #ifdef ESP32
   SemaphoreHandle_t _accessMutex;
+  SemaphoreHandle_t _payloadCacheMutex;
+  SemaphoreHandle_t _updateHandlersMutex;
 #endif
-  std::list<StateUpdateHandlerInfo_t> _updateHandlers;
+  StateUpdateHandlerInfo_t _updateHandlers[StateUpdateHandlerCapacity<T>::value];
+  size_t _updateHandlerCount;
 };
 
 #endif  // end StatefulService_h
@@ -0,0 +1,34 @@
+#include <StatusCache.h>
+
+uint32_t StatusCache::_totalHits = 0;
+uint32_t StatusCache::_totalMisses = 0;
+
+StatusCache::StatusCache(StatusReader reader, size_t bufferSize, uint32_t ttl) :
+    _reader(reader),
+    _bufferSize(bufferSize),
+    _ttl(ttl),
+    _valid(false),
+    _refreshedAt(0),
+    _hits(0),
+    _misses(0) {
+}
+
+String StatusCache::serialize() {
+  unsigned long now = millis();
+  if (_valid && (_ttl == 0 || now - _refreshedAt < _ttl)) {
+    _hits++;
+    _totalHits++;
+    return _body;
+  }
+  _misses++;
+  _totalMisses++;
+
+  DynamicJsonDocument jsonDocument(_bufferSize);
+  JsonObject root = jsonDocument.to<JsonObject>();
+  _reader(root);
+  _body = String();
+  serializeJson(jsonDocument, _body);
+  _valid = true;
+  _refreshedAt = now;
+  return _body;
+}
@@ -0,0 +1,60 @@
+#ifndef StatusCache_h
+#define StatusCache_h
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+#include <functional>
+
+// How long, in ms, status endpoints serve a previously serialized body before reading the status again
+#ifndef DEFAULT_STATUS_CACHE_TTL
+#define DEFAULT_STATUS_CACHE_TTL 1000
+#endif
+
+typedef std::function<void(JsonObject& root)> StatusReader;
+
+/**
+ * Holds the serialized body of a status endpoint for a short time, so clients polling together (several dashboards,
+ * or a batch request alongside a plain one) share a single read of the SDK and a single serialization. The status is
+ * only read again once the body is older than the TTL and it is next requested.
+ *
+ * A TTL of zero keeps the first body forever, for status which cannot change while running.
+ */
+class StatusCache {
+ public:
+  StatusCache(StatusReader reader, size_t bufferSize, uint32_t ttl = DEFAULT_STATUS_CACHE_TTL);
+
+  String serialize();
+
+  uint32_t getHits() {
+    return _hits;
+  }
+
+  uint32_t getMisses() {
+    return _misses;
+  }
+
+  // Hits and misses across every status cache
+  static uint32_t getTotalHits() {
+    return _totalHits;
+  }
+
+  static uint32_t getTotalMisses() {
+    return _totalMisses;
+  }
+
+ private:
+  static uint32_t _totalHits;
+  static uint32_t _totalMisses;
+
+  StatusReader _reader;
+  size_t _bufferSize;
+  uint32_t _ttl;
+  String _body;
+  bool _valid;
+  unsigned long _refreshedAt;
+  uint32_t _hits;
+  uint32_t _misses;
+};
+
+#endif  // end StatusCache_h
@@ -1,6 +1,10 @@
 #include <SystemStatus.h>
+#include <WebSocketTxRx.h>
 
-SystemStatus::SystemStatus(AsyncWebServer* server, SecurityManager* securityManager) {
+SystemStatus::SystemStatus(AsyncWebServer* server, SecurityManager* securityManager) :
+    _statusCache(std::bind(&SystemStatus::readStatus, this, std::placeholders::_1),
+                 MAX_ESP_STATUS_SIZE,
+                 SYSTEM_STATUS_CACHE_TTL) {
   server->on(SYSTEM_STATUS_SERVICE_PATH,
              HTTP_GET,
              securityManager->wrapRequest(std::bind(&SystemStatus::systemStatus, this, std::placeholders::_1),
@@ -8,8 +12,10 @@ SystemStatus::SystemStatus(AsyncWebServer* server, SecurityManager* securityMana
 }
 
 void SystemStatus::systemStatus(AsyncWebServerRequest* request) {
-  AsyncJsonResponse* response = new AsyncJsonResponse(false, MAX_ESP_STATUS_SIZE);
-  JsonObject root = response->getRoot();
+  request->send(200, JSON_MIMETYPE, _statusCache.serialize());
+}
+
+void SystemStatus::readStatus(JsonObject& root) {
 #ifdef ESP32
   root["esp_platform"] = "esp32";
   root["max_alloc_heap"] = ESP.getMaxAllocHeap();
@@ -40,6 +46,10 @@ void SystemStatus::systemStatus(AsyncWebServerRequest* request) {
   root["fs_used"] = fs_info.usedBytes;
 #endif
 
-  response->setLength();
-  request->send(response);
+  root["status_cache_hits"] = StatusCache::getTotalHits();
+  root["status_cache_misses"] = StatusCache::getTotalMisses();
+  root["requests_shed_busy"] = RequestGovernor::getShedBusy();
+  root["requests_shed_low_heap"] = RequestGovernor::getShedLowHeap();
+  root["ws_updates_coalesced"] = WebSocketTxBase::getTotalCoalesced();
+  root["ws_updates_dropped"] = WebSocketTxBase::getTotalDropped();
 }
@@ -12,18 +12,29 @@
 #include <ArduinoJson.h>
 #include <AsyncJson.h>
 #include <ESPAsyncWebServer.h>
+#include <StatusCache.h>
 #include <SecurityManager.h>
 #include <ESPFS.h>
 
 #define MAX_ESP_STATUS_SIZE 1024
+#ifndef SYSTEM_STATUS_CACHE_TTL
+#define SYSTEM_STATUS_CACHE_TTL DEFAULT_STATUS_CACHE_TTL
+#endif
 #define SYSTEM_STATUS_SERVICE_PATH "/rest/systemStatus"
 
 class SystemStatus {
  public:
   SystemStatus(AsyncWebServer* server, SecurityManager* securityManager);
 
+  String serializeStatus() {
+    return _statusCache.serialize();
+  }
+
  private:
+  StatusCache _statusCache;
+
   void systemStatus(AsyncWebServerRequest* request);
+  void readStatus(JsonObject& root);
 };
 
 #endif  // end SystemStatus_h
@@ -0,0 +1,39 @@
+#ifndef WWWDataHandler_h
+#define WWWDataHandler_h
+
+#include <ESPAsyncWebServer.h>
+#include <WWWData.h>
+
+/**
+ * Serves every web asset compiled into PROGMEM from a single handler. The asset is found with one probe of the perfect
+ * hash table generated alongside WWWData, so requests for other routes get past the assets without comparing their uri
+ * with each asset's in turn.
+ */
+class WWWDataHandler : public AsyncWebHandler {
+ public:
+  bool canHandle(AsyncWebServerRequest* request) override {
+    WWWAsset_t asset;
+    return request->method() == HTTP_GET && WWWData::findAsset(request->url().c_str(), asset);
+  }
+
+  void handleRequest(AsyncWebServerRequest* request) override {
+    sendAsset(request, request->url().c_str());
+  }
+
+  /*
+   * Send the asset at the uri, returning false if there isn't one
+   */
+  static bool sendAsset(AsyncWebServerRequest* request, const char* uri) {
+    WWWAsset_t asset;
+    if (!WWWData::findAsset(uri, asset)) {
+      return false;
+    }
+    AsyncWebServerResponse* response =
+        request->beginResponse_P(200, String(FPSTR(asset.contentType)), asset.content, asset.len);
+    response->addHeader("Content-Encoding", "gzip");
+    request->send(response);
+    return true;
+  }
+};
+
+#endif  // end WWWDataHandler_h
@@ -0,0 +1,71 @@
+#include <WebSocketTxRx.h>
+
+/**
+ * Writes into a message buffer, stopping at its length so nothing is written to the byte past it
+ */
+class MessageBufferWriter : public Print {
+ public:
+  MessageBufferWriter(uint8_t* buffer, size_t length) : _buffer(buffer), _length(length), _written(0) {
+  }
+
+  size_t write(uint8_t c) override {
+    return write(&c, 1);
+  }
+
+  size_t write(const uint8_t* data, size_t size) override {
+    size_t count = std::min(size, _length - _written);
+    memcpy(_buffer + _written, data, count);
+    _written += count;
+    return count;
+  }
+
+ private:
+  uint8_t* _buffer;
+  size_t _length;
+  size_t _written;
+};
+
+AsyncWebSocketMessageBuffer* WebSocketMessageBuffers::make(AsyncWebSocket& webSocket,
+                                                           const JsonDocument& jsonDocument) {
+  size_t len = measureJson(jsonDocument);
+  AsyncWebSocketMessageBuffer* buffer = webSocket.makeBuffer(len);
+  if (buffer) {
+    MessageBufferWriter writer(buffer->get(), len);
+    serializeJson(jsonDocument, writer);
+    buffer->lock();
+  }
+  return buffer;
+}
+
+void WebSocketMessageBuffers::release(AsyncWebSocket& webSocket,
+                                      std::initializer_list<AsyncWebSocketMessageBuffer*> buffers) {
+  for (AsyncWebSocketMessageBuffer* buffer : buffers) {
+    if (buffer) {
+      buffer->unlock();
+    }
+  }
+  webSocket._cleanBuffers();
+}
+
+WebSocketTxBase* WebSocketTxBase::_first = nullptr;
+uint32_t WebSocketTxBase::_totalCoalesced = 0;
+uint32_t WebSocketTxBase::_totalDropped = 0;
+
+WebSocketTxBase::WebSocketTxBase() : _next(_first) {
+  _first = this;
+}
+
+WebSocketTxBase::~WebSocketTxBase() {
+  for (WebSocketTxBase** transmitter = &_first; *transmitter; transmitter = &(*transmitter)->_next) {
+    if (*transmitter == this) {
+      *transmitter = _next;
+      break;
+    }
+  }
+}
+
+void WebSocketTxBase::loopAll() {
+  for (WebSocketTxBase* transmitter = _first; transmitter; transmitter = transmitter->_next) {
+    transmitter->loop();
+  }
+}
@@ -5,11 +5,81 @@
 #include <ESPAsyncWebServer.h>
 #include <SecurityManager.h>
 
+#include <algorithm>
+#include <initializer_list>
+#include <map>
+#include <vector>
+#ifdef ESP32
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#endif
+
 #define WEB_SOCKET_CLIENT_ID_MSG_SIZE 128
 
+// The largest message, in bytes, reassembled from several frames or packets for each client
+#ifndef WEB_SOCKET_MAX_MESSAGE_SIZE
+#define WEB_SOCKET_MAX_MESSAGE_SIZE 4096
+#endif
+
 #define WEB_SOCKET_ORIGIN "websocket"
 #define WEB_SOCKET_ORIGIN_CLIENT_ID_PREFIX "websocket:"
 
+typedef struct WebSocketClientBacklog {
+  bool stale;          // missed an update, so is sent the whole payload next
+  uint32_t coalesced;  // updates skipped while the client's queue was full
+  uint32_t dropped;    // updates lost because no message buffer could be allocated
+} WebSocketClientBacklog_t;
+
+/**
+ * Keeps WebSocketTx's use of AsyncWebSocketMessageBuffer internals in one place. AsyncWebSocket::textAll() uses the
+ * same internals to queue one buffer for many clients:
+ *  - makeBuffer(len) allocates len + 1 bytes but sends only len, so make() serializes exactly len bytes and does not
+ *    depend on the extra byte
+ *  - a buffer may be freed by the socket once every client it is queued for has sent it, so make() locks it until the
+ *    sender has queued it for every client
+ *  - release() unlocks the buffers and calls _cleanBuffers(), which frees the ones already sent
+ */
+class WebSocketMessageBuffers {
+ public:
+  // Serializes the document into a new locked buffer, returning nullptr if none could be allocated
+  static AsyncWebSocketMessageBuffer* make(AsyncWebSocket& webSocket, const JsonDocument& jsonDocument);
+
+  // Unlocks buffers returned by make() once queued, skipping null ones, and frees those already sent
+  static void release(AsyncWebSocket& webSocket, std::initializer_list<AsyncWebSocketMessageBuffer*> buffers);
+};
+
+/**
+ * Tracks every WebSocketTx instance, whatever its state type, so clients which fell behind can be brought up to date
+ * from the main loop once their queue has drained.
+ */
+class WebSocketTxBase {
+ public:
+  // Sends the latest payload to clients which missed updates once they have room, call regularly from the main loop
+  static void loopAll();
+
+  // Updates skipped or lost across every client of every WebSocketTx
+  static uint32_t getTotalCoalesced() {
+    return _totalCoalesced;
+  }
+
+  static uint32_t getTotalDropped() {
+    return _totalDropped;
+  }
+
+ protected:
+  static uint32_t _totalCoalesced;
+  static uint32_t _totalDropped;
+
+  WebSocketTxBase();
+  virtual ~WebSocketTxBase();
+
+  virtual void loop() = 0;
+
+ private:
+  static WebSocketTxBase* _first;
+  WebSocketTxBase* _next;
+};
+
 template <class T>
 class WebSocketConnector {
  protected:
@@ -73,10 +143,15 @@ class WebSocketConnector {
   }
 };
 
-template <class T>
-class WebSocketTx : virtual public WebSocketConnector<T> {
+/**
+ * Broadcasts state changes to every client. A client which can't keep up is not queued every intermediate state: while
+ * its AsyncWebSocket queue is full (WS_MAX_QUEUED_MESSAGES) updates are skipped for it, and once the queue drains it is
+ * sent only the latest payload. Heap use is then bounded however slow a client is.
+ */
+template <class T, class StateReader = JsonStateReader<T>>
+class WebSocketTx : virtual public WebSocketConnector<T>, public WebSocketTxBase {
  public:
-  WebSocketTx(JsonStateReader<T> stateReader,
+  WebSocketTx(StateReader stateReader,
               StatefulService<T>* statefulService,
               AsyncWebServer* server,
               const char* webSocketPath,
@@ -90,18 +165,51 @@ class WebSocketTx : virtual public WebSocketConnector<T> {
                             authenticationPredicate,
                             bufferSize),
       _stateReader(stateReader) {
+#ifdef ESP32
+    _accessMutex = xSemaphoreCreateRecursiveMutex();
+#endif
     WebSocketConnector<T>::_statefulService->addUpdateHandler(
-        [&](const String& originId) { transmitData(nullptr, originId); }, false);
+        [&](const String& originId, state_field_mask_t changedFields) {
+          transmitData(nullptr, originId, changedFields);
+        },
+        false);
   }
 
-  WebSocketTx(JsonStateReader<T> stateReader,
+  WebSocketTx(StateReader stateReader,
               StatefulService<T>* statefulService,
               AsyncWebServer* server,
               const char* webSocketPath,
               size_t bufferSize = DEFAULT_BUFFER_SIZE) :
       WebSocketConnector<T>(statefulService, server, webSocketPath, bufferSize), _stateReader(stateReader) {
+#ifdef ESP32
+    _accessMutex = xSemaphoreCreateRecursiveMutex();
+#endif
     WebSocketConnector<T>::_statefulService->addUpdateHandler(
-        [&](const String& originId) { transmitData(nullptr, originId); }, false);
+        [&](const String& originId, state_field_mask_t changedFields) {
+          transmitData(nullptr, originId, changedFields);
+        },
+        false);
+  }
+
+  /**
+   * Enables delta messages. Once set, changes made by a delta updater are broadcast as a "delta" message carrying only
+   * the changed fields, which clients merge into the payload they already hold. Newly connected clients always
+   * receive the full payload.
+   */
+  void setDeltaReader(JsonStateDeltaReader<T> deltaReader) {
+    _deltaReader = deltaReader;
+  }
+
+  // Copies the backlog of a connected client, returning false if the client is unknown
+  bool getBacklog(uint32_t clientId, WebSocketClientBacklog_t& backlog) {
+    beginTransaction();
+    auto entry = _backlogs.find(clientId);
+    bool found = entry != _backlogs.end();
+    if (found) {
+      backlog = entry->second;
+    }
+    endTransaction();
+    return found;
   }
 
  protected:
@@ -113,68 +221,158 @@ class WebSocketTx : virtual public WebSocketConnector<T> {
                          size_t len) {
     if (type == WS_EVT_CONNECT) {
       Serial.printf("[WS] Client connected: %u\n", client->id());
+      beginTransaction();
+      _backlogs[client->id()] = {false, 0, 0};
+      endTransaction();
       // when a client connects, we transmit it's id and the current payload
       transmitId(client);
       transmitData(client, WEB_SOCKET_ORIGIN);
     } else if (type == WS_EVT_DISCONNECT) {
       Serial.printf("[WS] Client disconnected: %u\n", client->id());
+      beginTransaction();
+      _backlogs.erase(client->id());
+      endTransaction();
     } else if (type == WS_EVT_ERROR) {
       Serial.printf("[WS] Client error: %u\n", client->id());
     }
   }
 
  private:
-  JsonStateReader<T> _stateReader;
+  StateReader _stateReader;
+  JsonStateDeltaReader<T> _deltaReader;
+  std::map<uint32_t, WebSocketClientBacklog_t> _backlogs;
+#ifdef ESP32
+  SemaphoreHandle_t _accessMutex;
+#endif
+
+  // update handlers, websocket events and the main loop may run on different tasks
+  inline void beginTransaction() {
+#ifdef ESP32
+    xSemaphoreTakeRecursive(_accessMutex, portMAX_DELAY);
+#endif
+  }
+
+  inline void endTransaction() {
+#ifdef ESP32
+    xSemaphoreGiveRecursive(_accessMutex);
+#endif
+  }
+
+  void loop() {
+    bool stale = false;
+    beginTransaction();
+    for (auto& entry : _backlogs) {
+      stale = stale || entry.second.stale;
+    }
+    endTransaction();
+    if (stale) {
+      transmitData(nullptr, WEB_SOCKET_ORIGIN, STATE_FIELDS_ALL, true);
+    }
+  }
 
   void transmitId(AsyncWebSocketClient* client) {
     DynamicJsonDocument jsonDocument = DynamicJsonDocument(WEB_SOCKET_CLIENT_ID_MSG_SIZE);
     JsonObject root = jsonDocument.to<JsonObject>();
     root["type"] = "id";
     root["id"] = WebSocketConnector<T>::clientId(client);
-    size_t len = measureJson(jsonDocument);
-    // Allocate len+1 so serializeJson can write the null terminator safely,
-    // but only send len bytes (the actual JSON, without the null)
-    AsyncWebSocketMessageBuffer* buffer = WebSocketConnector<T>::_webSocket.makeBuffer(len + 1);
+    AsyncWebSocketMessageBuffer* buffer =
+        WebSocketMessageBuffers::make(WebSocketConnector<T>::_webSocket, jsonDocument);
     if (buffer) {
-      serializeJson(jsonDocument, (char*)buffer->get(), len + 1);
-      client->text((char*)buffer->get(), len);
+      client->text(buffer);
     }
+    WebSocketMessageBuffers::release(WebSocketConnector<T>::_webSocket, {buffer});
   }
 
   /**
    * Broadcasts the payload to the destination, if provided. Otherwise broadcasts to all clients except the origin, if
-   * specified.
+   * specified. When catching up only clients which missed an update are sent to.
    *
    * Original implementation sent clients their own IDs so they could ignore updates they initiated. This approach
    * simplifies the client and the server implementation but may not be sufficent for all use-cases.
    */
-  void transmitData(AsyncWebSocketClient* client, const String& originId) {
-    DynamicJsonDocument jsonDocument = DynamicJsonDocument(WebSocketConnector<T>::_bufferSize);
-    JsonObject root = jsonDocument.to<JsonObject>();
-    root["type"] = "payload";
-    root["origin_id"] = originId;
-    JsonObject payload = root.createNestedObject("payload");
-    WebSocketConnector<T>::_statefulService->read(payload, _stateReader);
+  void transmitData(AsyncWebSocketClient* client,
+                    const String& originId,
+                    state_field_mask_t fields = STATE_FIELDS_ALL,
+                    bool catchingUp = false) {
+    bool delta = _deltaReader && fields != STATE_FIELDS_ALL;
+    // both messages are built on first use, clients which missed an update need the whole payload even for a delta
+    AsyncWebSocketMessageBuffer* message = nullptr;
+    AsyncWebSocketMessageBuffer* payloadMessage = nullptr;
 
-    size_t len = measureJson(jsonDocument);
-    // Allocate len+1 so serializeJson can write the null terminator safely,
-    // but only send len bytes (the actual JSON, without the null)
-    AsyncWebSocketMessageBuffer* buffer = WebSocketConnector<T>::_webSocket.makeBuffer(len + 1);
-    if (buffer) {
-      serializeJson(jsonDocument, (char*)buffer->get(), len + 1);
-      if (client) {
-        client->text((char*)buffer->get(), len);
-      } else {
-        WebSocketConnector<T>::_webSocket.textAll((char*)buffer->get(), len);
+    beginTransaction();
+    for (auto& entry : _backlogs) {
+      AsyncWebSocketClient* target = WebSocketConnector<T>::_webSocket.client(entry.first);
+      WebSocketClientBacklog_t& backlog = entry.second;
+      if (!target || target->status() != WS_CONNECTED || (client && target != client) ||
+          (catchingUp && !backlog.stale)) {
+        continue;
+      }
+      if (target->queueIsFull()) {
+        if (catchingUp) {
+          continue;
+        }
+        if (!backlog.stale) {
+          Serial.printf("[WS] Client %u fell behind, coalescing updates\n", target->id());
+        }
+        backlog.stale = true;
+        backlog.coalesced++;
+        _totalCoalesced++;
+        continue;
       }
+      AsyncWebSocketMessageBuffer*& buffer = delta && !backlog.stale ? message : payloadMessage;
+      if (!buffer) {
+        buffer = makeMessage(originId, delta && !backlog.stale ? fields : STATE_FIELDS_ALL);
+      }
+      if (!buffer) {
+        backlog.stale = true;
+        backlog.dropped++;
+        _totalDropped++;
+        continue;
+      }
+      target->text(buffer);
+      backlog.stale = false;
+    }
+    endTransaction();
+
+    WebSocketMessageBuffers::release(WebSocketConnector<T>::_webSocket, {message, payloadMessage});
+  }
+
+  /**
+   * Serializes the payload, or the changed fields as a delta, into a locked message buffer which may be queued for any
+   * number of clients.
+   */
+  AsyncWebSocketMessageBuffer* makeMessage(const String& originId, state_field_mask_t fields) {
+    bool delta = fields != STATE_FIELDS_ALL;
+    String payload;
+    if (delta) {
+      std::unique_ptr<DynamicJsonDocument> payloadDocument = WebSocketConnector<T>::_statefulService->readDocument(
+          [&](T& settings, JsonObject& root) { _deltaReader(settings, root, fields); },
+          WebSocketConnector<T>::_bufferSize);
+      serializeJson(*payloadDocument, payload);
+    } else {
+      payload = WebSocketConnector<T>::_statefulService->serialize(_stateReader, WebSocketConnector<T>::_bufferSize);
     }
+
+    // the serialized payload is embedded as raw JSON so the envelope only needs room for the type and origin
+    DynamicJsonDocument jsonDocument = DynamicJsonDocument(WEB_SOCKET_CLIENT_ID_MSG_SIZE);
+    JsonObject root = jsonDocument.to<JsonObject>();
+    root["type"] = delta ? "delta" : "payload";
+    root["origin_id"] = originId;
+    root["payload"] = serialized(payload.c_str(), payload.length());
+
+    return WebSocketMessageBuffers::make(WebSocketConnector<T>::_webSocket, jsonDocument);
   }
 };
 
-template <class T>
+/**
+ * Applies the JSON messages clients send. Messages which arrive in several frames, or in several packets, are
+ * reassembled per client up to WEB_SOCKET_MAX_MESSAGE_SIZE bytes (see setMaxMessageSize) and applied once complete.
+ * Longer messages are discarded. Each message is parsed into a document sized for it (see JsonUtils::readJson).
+ */
+template <class T, class StateUpdater = JsonStateUpdater<T>>
 class WebSocketRx : virtual public WebSocketConnector<T> {
  public:
-  WebSocketRx(JsonStateUpdater<T> stateUpdater,
+  WebSocketRx(StateUpdater stateUpdater,
               StatefulService<T>* statefulService,
               AsyncWebServer* server,
               const char* webSocketPath,
@@ -187,15 +385,27 @@ class WebSocketRx : virtual public WebSocketConnector<T> {
                             securityManager,
                             authenticationPredicate,
                             bufferSize),
-      _stateUpdater(stateUpdater) {
+      _stateUpdater(stateUpdater),
+      _maxMessageSize(WEB_SOCKET_MAX_MESSAGE_SIZE) {
   }
 
-  WebSocketRx(JsonStateUpdater<T> stateUpdater,
+  WebSocketRx(StateUpdater stateUpdater,
               StatefulService<T>* statefulService,
               AsyncWebServer* server,
               const char* webSocketPath,
               size_t bufferSize = DEFAULT_BUFFER_SIZE) :
-      WebSocketConnector<T>(statefulService, server, webSocketPath, bufferSize), _stateUpdater(stateUpdater) {
+      WebSocketConnector<T>(statefulService, server, webSocketPath, bufferSize),
+      _stateUpdater(stateUpdater),
+      _maxMessageSize(WEB_SOCKET_MAX_MESSAGE_SIZE) {
+  }
+
+  // Applies incoming messages with a delta updater, so changed fields are tracked for delta transmission
+  void setDeltaUpdater(JsonStateDeltaUpdater<T> deltaUpdater) {
+    _deltaUpdater = deltaUpdater;
+  }
+
+  void setMaxMessageSize(size_t maxMessageSize) {
+    _maxMessageSize = maxMessageSize;
   }
 
  protected:
@@ -207,29 +417,81 @@ class WebSocketRx : virtual public WebSocketConnector<T> {
                          size_t len) {
     if (type == WS_EVT_DATA) {
       AwsFrameInfo* info = (AwsFrameInfo*)arg;
-      if (info->final && info->index == 0 && info->len == len) {
+      // a message in a single frame and packet is applied in place, the last frame of a longer one may look the same
+      if (info->final && info->num == 0 && info->index == 0 && info->len == len) {
         if (info->opcode == WS_TEXT) {
-          DynamicJsonDocument jsonDocument = DynamicJsonDocument(WebSocketConnector<T>::_bufferSize);
-          DeserializationError error = deserializeJson(jsonDocument, (char*)data);
-          if (!error && jsonDocument.is<JsonObject>()) {
-            JsonObject jsonObject = jsonDocument.as<JsonObject>();
-            WebSocketConnector<T>::_statefulService->update(
-                jsonObject, _stateUpdater, WebSocketConnector<T>::clientId(client));
-          }
+          applyMessage(client, (const char*)data, len);
         }
+      } else {
+        reassembleMessage(client, info, data, len);
       }
+    } else if (type == WS_EVT_DISCONNECT) {
+      _partialMessages.erase(client->id());
     }
   }
 
  private:
-  JsonStateUpdater<T> _stateUpdater;
+  StateUpdater _stateUpdater;
+  JsonStateDeltaUpdater<T> _deltaUpdater;
+  size_t _maxMessageSize;
+  // text received so far of each client's incomplete message, websocket events all arrive on the same task
+  std::map<uint32_t, std::vector<char>> _partialMessages;
+
+  // the document is sized for the message, which may be larger than the buffer size once reassembled
+  void applyMessage(AsyncWebSocketClient* client, const char* message, size_t length) {
+    std::unique_ptr<DynamicJsonDocument> jsonDocument;
+    DeserializationError error = JsonUtils::readJson(jsonDocument, message, length, WebSocketConnector<T>::_bufferSize);
+    if (error == DeserializationError::NoMemory) {
+      Serial.printf("[WS] Not enough memory to parse the %u byte message from client %u\n", length, client->id());
+    }
+    if (!error && jsonDocument->is<JsonObject>()) {
+      JsonObject jsonObject = jsonDocument->as<JsonObject>();
+      if (_deltaUpdater) {
+        WebSocketConnector<T>::_statefulService->update(
+            jsonObject, _deltaUpdater, WebSocketConnector<T>::clientId(client));
+      } else {
+        WebSocketConnector<T>::_statefulService->update(
+            jsonObject, _stateUpdater, WebSocketConnector<T>::clientId(client));
+      }
+    }
+  }
+
+  /**
+   * Appends a packet to the client's message, applying the message once its last frame is complete. A message is
+   * started by the first packet of its first frame, packets belonging to a message which was discarded are ignored.
+   */
+  void reassembleMessage(AsyncWebSocketClient* client, AwsFrameInfo* info, uint8_t* data, size_t len) {
+    uint32_t clientId = client->id();
+    if (info->num == 0 && info->index == 0) {
+      _partialMessages.erase(clientId);
+      if (info->message_opcode != WS_TEXT) {
+        return;
+      }
+      _partialMessages[clientId].reserve(std::min((size_t)info->len, _maxMessageSize));
+    }
+    auto entry = _partialMessages.find(clientId);
+    if (entry == _partialMessages.end()) {
+      return;
+    }
+    std::vector<char>& message = entry->second;
+    if (message.size() + len > _maxMessageSize) {
+      Serial.printf("[WS] Message from client %u exceeds %u bytes, discarded\n", clientId, _maxMessageSize);
+      _partialMessages.erase(entry);
+      return;
+    }
+    message.insert(message.end(), data, data + len);
+    if (info->final && info->index + len == info->len) {
+      applyMessage(client, message.data(), message.size());
+      _partialMessages.erase(clientId);
+    }
+  }
 };
 
-template <class T>
-class WebSocketTxRx : public WebSocketTx<T>, public WebSocketRx<T> {
+template <class T, class StateReader = JsonStateReader<T>, class StateUpdater = JsonStateUpdater<T>>
+class WebSocketTxRx : public WebSocketTx<T, StateReader>, public WebSocketRx<T, StateUpdater> {
  public:
-  WebSocketTxRx(JsonStateReader<T> stateReader,
-                JsonStateUpdater<T> stateUpdater,
+  WebSocketTxRx(StateReader stateReader,
+                StateUpdater stateUpdater,
                 StatefulService<T>* statefulService,
                 AsyncWebServer* server,
                 const char* webSocketPath,
@@ -242,31 +504,31 @@ class WebSocketTxRx : public WebSocketTx<T>, public WebSocketRx<T> {
                             securityManager,
                             authenticationPredicate,
                             bufferSize),
-      WebSocketTx<T>(stateReader,
-                     statefulService,
-                     server,
-                     webSocketPath,
-                     securityManager,
-                     authenticationPredicate,
-                     bufferSize),
-      WebSocketRx<T>(stateUpdater,
-                     statefulService,
-                     server,
-                     webSocketPath,
-                     securityManager,
-                     authenticationPredicate,
-                     bufferSize) {
+      WebSocketTx<T, StateReader>(stateReader,
+                                  statefulService,
+                                  server,
+                                  webSocketPath,
+                                  securityManager,
+                                  authenticationPredicate,
+                                  bufferSize),
+      WebSocketRx<T, StateUpdater>(stateUpdater,
+                                   statefulService,
+                                   server,
+                                   webSocketPath,
+                                   securityManager,
+                                   authenticationPredicate,
+                                   bufferSize) {
   }
 
-  WebSocketTxRx(JsonStateReader<T> stateReader,
-                JsonStateUpdater<T> stateUpdater,
+  WebSocketTxRx(StateReader stateReader,
+                StateUpdater stateUpdater,
                 StatefulService<T>* statefulService,
                 AsyncWebServer* server,
                 const char* webSocketPath,
                 size_t bufferSize = DEFAULT_BUFFER_SIZE) :
       WebSocketConnector<T>(statefulService, server, webSocketPath, bufferSize),
-      WebSocketTx<T>(stateReader, statefulService, server, webSocketPath, bufferSize),
-      WebSocketRx<T>(stateUpdater, statefulService, server, webSocketPath, bufferSize) {
+      WebSocketTx<T, StateReader>(stateReader, statefulService, server, webSocketPath, bufferSize),
+      WebSocketRx<T, StateUpdater>(stateUpdater, statefulService, server, webSocketPath, bufferSize) {
   }
 
  protected:
@@ -276,8 +538,8 @@ class WebSocketTxRx : public WebSocketTx<T>, public WebSocketRx<T> {
                  void* arg,
                  uint8_t* data,
                  size_t len) {
-    WebSocketRx<T>::onWSEvent(server, client, type, arg, data, len);
-    WebSocketTx<T>::onWSEvent(server, client, type, arg, data, len);
+    WebSocketRx<T, StateUpdater>::onWSEvent(server, client, type, arg, data, len);
+    WebSocketTx<T, StateReader>::onWSEvent(server, client, type, arg, data, len);
   }
 };
 
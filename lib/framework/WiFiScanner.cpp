@@ -22,23 +22,28 @@ void WiFiScanner::scanNetworks(AsyncWebServerRequest* request) {
 void WiFiScanner::listNetworks(AsyncWebServerRequest* request) {
   int numNetworks = WiFi.scanComplete();
   if (numNetworks > -1) {
-    AsyncJsonResponse* response = new AsyncJsonResponse(false, MAX_WIFI_SCANNER_SIZE);
-    JsonObject root = response->getRoot();
-    JsonArray networks = root.createNestedArray("networks");
-    for (int i = 0; i < numNetworks; i++) {
-      JsonObject network = networks.createNestedObject();
-      network["rssi"] = WiFi.RSSI(i);
-      network["ssid"] = WiFi.SSID(i);
-      network["bssid"] = WiFi.BSSIDstr(i);
-      network["channel"] = WiFi.channel(i);
-#ifdef ESP32
-      network["encryption_type"] = (uint8_t)WiFi.encryptionType(i);
-#elif defined(ESP8266)
-      network["encryption_type"] = convertEncryptionType(WiFi.encryptionType(i));
-#endif
-    }
-    response->setLength();
-    request->send(response);
+    // stream the list a network at a time as the connection has room, serializing from a copy of the results taken
+    // now, as the driver's results are replaced as soon as another scan starts
+    std::shared_ptr<std::vector<WiFiNetwork_t>> networks = snapshotNetworks(numNetworks);
+    size_t i = 0;
+    bool started = false;
+    request->send(ChunkedJsonResponse::begin(request, [this, networks, i, started](String& fragment) mutable {
+      if (!started) {
+        fragment = "{\"networks\":[";
+        started = true;
+      } else if (i < networks->size()) {
+        if (i > 0) {
+          fragment = ",";
+        }
+        serializeNetwork((*networks)[i++], fragment);
+      } else if (i == networks->size()) {
+        fragment = "]}";
+        i++;
+      } else {
+        return false;
+      }
+      return true;
+    }));
   } else if (numNetworks == -1) {
     request->send(202);
   } else {
@@ -46,6 +51,38 @@ void WiFiScanner::listNetworks(AsyncWebServerRequest* request) {
   }
 }
 
+std::shared_ptr<std::vector<WiFiNetwork_t>> WiFiScanner::snapshotNetworks(int numNetworks) {
+  std::shared_ptr<std::vector<WiFiNetwork_t>> networks = std::make_shared<std::vector<WiFiNetwork_t>>();
+  networks->reserve(numNetworks);
+  for (int i = 0; i < numNetworks; i++) {
+    WiFiNetwork_t network;
+    network.ssid = WiFi.SSID(i);
+    network.bssid = WiFi.BSSIDstr(i);
+    network.rssi = WiFi.RSSI(i);
+    network.channel = WiFi.channel(i);
+#ifdef ESP32
+    network.encryptionType = (uint8_t)WiFi.encryptionType(i);
+#elif defined(ESP8266)
+    network.encryptionType = convertEncryptionType(WiFi.encryptionType(i));
+#endif
+    networks->push_back(network);
+  }
+  return networks;
+}
+
+void WiFiScanner::serializeNetwork(const WiFiNetwork_t& network, String& output) {
+  StaticJsonDocument<MAX_WIFI_NETWORK_SIZE> jsonDocument;
+  JsonObject root = jsonDocument.to<JsonObject>();
+  root["rssi"] = network.rssi;
+  root["ssid"] = network.ssid;
+  root["bssid"] = network.bssid;
+  root["channel"] = network.channel;
+  root["encryption_type"] = network.encryptionType;
+  String serialized;
+  serializeJson(jsonDocument, serialized);
+  output += serialized;
+}
+
 #ifdef ESP8266
 /*
  * Convert encryption type to standard used by ESP32 rather than the translated form which the esp8266 libaries expose.
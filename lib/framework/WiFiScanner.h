@@ -12,12 +12,29 @@
 #include <ArduinoJson.h>
 #include <AsyncJson.h>
 #include <ESPAsyncWebServer.h>
+#include <ChunkedJsonResponse.h>
 #include <SecurityManager.h>
 
+#include <memory>
+#include <vector>
+
 #define SCAN_NETWORKS_SERVICE_PATH "/rest/scanNetworks"
 #define LIST_NETWORKS_SERVICE_PATH "/rest/listNetworks"
 
-#define MAX_WIFI_SCANNER_SIZE 1024
+// Networks are serialized one at a time, so only a single network needs to fit
+#define MAX_WIFI_NETWORK_SIZE 256
+
+/**
+ * A network found by the last scan, copied out of the WiFi driver when a list response starts so a scan requested
+ * while the list is still streaming can't change the results under it.
+ */
+typedef struct WiFiNetwork {
+  String ssid;
+  String bssid;
+  int32_t rssi;
+  uint8_t channel;
+  uint8_t encryptionType;
+} WiFiNetwork_t;
 
 class WiFiScanner {
  public:
@@ -26,6 +43,8 @@ class WiFiScanner {
  private:
   void scanNetworks(AsyncWebServerRequest* request);
   void listNetworks(AsyncWebServerRequest* request);
+  std::shared_ptr<std::vector<WiFiNetwork_t>> snapshotNetworks(int numNetworks);
+  void serializeNetwork(const WiFiNetwork_t& network, String& output);
 
 #ifdef ESP8266
   uint8_t convertEncryptionType(uint8_t encryptionType);
@@ -84,6 +84,9 @@ class WiFiSettings {
   }
 };
 
+typedef StaticJsonStateReader<WiFiSettings, WiFiSettings::read> WiFiSettingsReader;
+typedef StaticJsonStateUpdater<WiFiSettings, WiFiSettings::update> WiFiSettingsUpdater;
+
 class WiFiSettingsService : public StatefulService<WiFiSettings> {
  public:
   WiFiSettingsService(AsyncWebServer* server, FS* fs, SecurityManager* securityManager);
@@ -92,8 +95,8 @@ class WiFiSettingsService : public StatefulService<WiFiSettings> {
   void loop();
 
  private:
-  HttpEndpoint<WiFiSettings> _httpEndpoint;
-  FSPersistence<WiFiSettings> _fsPersistence;
+  HttpEndpoint<WiFiSettings, WiFiSettingsReader, WiFiSettingsUpdater> _httpEndpoint;
+  FSPersistence<WiFiSettings, WiFiSettingsReader, WiFiSettingsUpdater> _fsPersistence;
   unsigned long _lastConnectionAttempt;
 
 #ifdef ESP32
@@ -1,6 +1,9 @@
 #include <WiFiStatus.h>
 
-WiFiStatus::WiFiStatus(AsyncWebServer* server, SecurityManager* securityManager) {
+WiFiStatus::WiFiStatus(AsyncWebServer* server, SecurityManager* securityManager) :
+    _statusCache(std::bind(&WiFiStatus::readStatus, this, std::placeholders::_1),
+                 MAX_WIFI_STATUS_SIZE,
+                 WIFI_STATUS_CACHE_TTL) {
   server->on(WIFI_STATUS_SERVICE_PATH,
              HTTP_GET,
              securityManager->wrapRequest(std::bind(&WiFiStatus::wifiStatus, this, std::placeholders::_1),
@@ -48,8 +51,10 @@ void WiFiStatus::onStationModeGotIP(const WiFiEventStationModeGotIP& event) {
 #endif
 
 void WiFiStatus::wifiStatus(AsyncWebServerRequest* request) {
-  AsyncJsonResponse* response = new AsyncJsonResponse(false, MAX_WIFI_STATUS_SIZE);
-  JsonObject root = response->getRoot();
+  request->send(200, JSON_MIMETYPE, _statusCache.serialize());
+}
+
+void WiFiStatus::readStatus(JsonObject& root) {
   wl_status_t status = WiFi.status();
   root["status"] = (uint8_t)status;
   if (status == WL_CONNECTED) {
@@ -70,6 +75,4 @@ void WiFiStatus::wifiStatus(AsyncWebServerRequest* request) {
       root["dns_ip_2"] = dnsIP2.toString();
     }
   }
-  response->setLength();
-  request->send(response);
 }
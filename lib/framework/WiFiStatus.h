@@ -12,16 +12,24 @@
 #include <ArduinoJson.h>
 #include <AsyncJson.h>
 #include <ESPAsyncWebServer.h>
+#include <StatusCache.h>
 #include <IPUtils.h>
 #include <SecurityManager.h>
 
 #define MAX_WIFI_STATUS_SIZE 1024
+#ifndef WIFI_STATUS_CACHE_TTL
+#define WIFI_STATUS_CACHE_TTL DEFAULT_STATUS_CACHE_TTL
+#endif
 #define WIFI_STATUS_SERVICE_PATH "/rest/wifiStatus"
 
 class WiFiStatus {
  public:
   WiFiStatus(AsyncWebServer* server, SecurityManager* securityManager);
 
+  String serializeStatus() {
+    return _statusCache.serialize();
+  }
+
  private:
 #ifdef ESP32
   // static functions for logging WiFi events to the UART
@@ -39,7 +47,10 @@ class WiFiStatus {
   static void onStationModeGotIP(const WiFiEventStationModeGotIP& event);
 #endif
 
+  StatusCache _statusCache;
+
   void wifiStatus(AsyncWebServerRequest* request);
+  void readStatus(JsonObject& root);
 };
 
 #endif  // end WiFiStatus_h
@@ -0,0 +1,175 @@
+#!/usr/bin/env python3
+# Simulates the flash erases caused by saving settings, comparing FlashJournal with today's rewrite of a file on
+# LittleFS. Run on the host: python3 scripts/journal_wear.py [--state-size 200] [--change-size 24] ...
+#
+# The journal is simulated record for record, following FlashJournal.cpp. The file rewrite is a model of LittleFS,
+# whose cost depends on whether the file is small enough to be held inline in its directory's metadata:
+#  - an inline file is rewritten by three metadata commits (create the temporary file, write its data on close,
+#    rename it over the file, which copies the data again), and a metadata block is erased each time it fills
+#  - a larger file is written to newly erased data blocks, and the same three commits hold only its block pointers
+from argparse import ArgumentParser
+
+SECTOR_SIZE = 4096
+SECTOR_HEADER_SIZE = 16
+RECORD_HEADER_SIZE = 20
+RESERVED_SECTORS = 1
+MAX_RECORD_SIZE = (SECTOR_SIZE - SECTOR_HEADER_SIZE) // 2
+
+BLOCK_SIZE = 4096
+INLINE_MAX = 512
+COMMIT_OVERHEAD = 48
+NAME_LENGTH = 24
+
+
+def recordSize(length):
+    return (RECORD_HEADER_SIZE + length + 3) & ~3
+
+
+class Journal:
+    def __init__(self, partitionSize, maxChanges):
+        self.sectors = [0] * (partitionSize // SECTOR_SIZE)
+        self.ends = [0] * len(self.sectors)
+        self.head = 0
+        self.sequence = 0
+        self.maxChanges = maxChanges
+        # key -> list of [sector, size], full record first
+        self.index = {}
+        self.sectorErases = [0] * len(self.sectors)
+        self.moved = 0
+
+    def freeSectors(self):
+        return self.sectors.count(0)
+
+    def capacity(self):
+        return (len(self.sectors) - RESERVED_SECTORS - 2) * MAX_RECORD_SIZE
+
+    def liveSize(self):
+        return sum(size for chain in self.index.values() for sector, size in chain)
+
+    def put(self, key, length):
+        size = recordSize(length)
+        superseded = sum(size for sector, size in self.index.get(key, []))
+        if size > MAX_RECORD_SIZE or self.liveSize() - superseded + size > self.capacity():
+            raise RuntimeError("journal full")
+        self.index[key] = [[self.append(size), size]]
+
+    def putChange(self, key, length):
+        chain = self.index.get(key)
+        size = recordSize(length)
+        if not chain or len(chain) > self.maxChanges or self.liveSize() + size > self.capacity():
+            return False
+        chain.append([self.append(size), size])
+        return True
+
+    def append(self, size, reclaiming=False):
+        if not self.sectors[self.head] or self.ends[self.head] + size > SECTOR_SIZE:
+            self.openSector(reclaiming)
+        self.ends[self.head] += size
+        return self.head
+
+    def openSector(self, reclaiming):
+        if not reclaiming:
+            for attempt in range(len(self.sectors)):
+                if self.freeSectors() > RESERVED_SECTORS or not self.reclaim():
+                    break
+            if self.freeSectors() <= RESERVED_SECTORS:
+                raise RuntimeError("no sector could be reclaimed")
+        sector = self.head
+        while True:
+            sector = (sector + 1) % len(self.sectors)
+            if not self.sectors[sector]:
+                break
+        self.sequence += 1
+        self.sectors[sector] = self.sequence
+        self.ends[sector] = SECTOR_HEADER_SIZE
+        self.head = sector
+
+    def victim(self):
+        live = [0] * len(self.sectors)
+        for chain in self.index.values():
+            for sector, size in chain:
+                live[sector] += size
+        candidates = [sector for sector in range(len(self.sectors)) if self.sectors[sector] and sector != self.head and
+                      self.ends[sector] - SECTOR_HEADER_SIZE != live[sector]]
+        return min(candidates, key=lambda sector: self.sectors[sector]) if candidates else -1
+
+    def reclaim(self):
+        sector = self.victim()
+        if sector < 0:
+            return False
+        for chain in self.index.values():
+            for record in chain:
+                if record[0] == sector:
+                    record[0] = self.append(record[1], True)
+                    self.moved += 1
+        self.sectors[sector] = 0
+        self.ends[sector] = 0
+        self.sectorErases[sector] += 1
+        return True
+
+    def loop(self):
+        if self.freeSectors() <= RESERVED_SECTORS + 1 and self.victim() >= 0:
+            self.reclaim()
+
+
+class LittleFSModel:
+    def __init__(self, files, size):
+        # metadata held for each file: its name, and its data if inline or else a pointer to its blocks
+        self.held = size if size <= INLINE_MAX else 8
+        # bytes of the directory's metadata which survive compaction, those of the other settings files included
+        self.live = files * (NAME_LENGTH + COMMIT_OVERHEAD + self.held)
+        self.used = self.live
+        self.erases = 0
+
+    def rewrite(self, size):
+        if size > INLINE_MAX:
+            self.erases += (size + BLOCK_SIZE - 1) // BLOCK_SIZE
+        for commit in (NAME_LENGTH + COMMIT_OVERHEAD, self.held + COMMIT_OVERHEAD,
+                       NAME_LENGTH + self.held + COMMIT_OVERHEAD):
+            if self.used + commit > BLOCK_SIZE:
+                # compaction erases the other block of the metadata pair and copies the live metadata into it
+                self.erases += 1
+                self.used = self.live
+            self.used += commit
+
+
+def simulate(args):
+    journal = Journal(args.partition_size, args.max_changes)
+    fs = LittleFSModel(args.other_files + args.services, args.state_size)
+    for key in range(args.other_files):
+        journal.put(key, args.state_size)
+    for update in range(args.updates):
+        key = update % args.services
+        full = args.change_size == 0 or update % args.full_every == 0
+        if full or not journal.putChange(args.other_files + key, args.change_size):
+            journal.put(args.other_files + key, args.state_size)
+        if update % args.loop_every == 0:
+            journal.loop()
+        fs.rewrite(args.state_size)
+    return journal, fs
+
+
+def main():
+    parser = ArgumentParser(description="Flash erases per thousand settings saves, FlashJournal against LittleFS")
+    parser.add_argument("--updates", type=int, default=100000, help="saves to simulate")
+    parser.add_argument("--state-size", type=int, default=200, help="bytes in the serialized state")
+    parser.add_argument("--change-size", type=int, default=24, help="bytes in a change record, 0 saves in full")
+    parser.add_argument("--full-every", type=int, default=1000000, help="saves between changes of the whole state")
+    parser.add_argument("--max-changes", type=int, default=32, help="FLASH_JOURNAL_MAX_CHANGES")
+    parser.add_argument("--services", type=int, default=1, help="journaled services sharing the saves")
+    parser.add_argument("--other-files", type=int, default=8, help="settings which rarely change")
+    parser.add_argument("--partition-size", type=int, default=0x10000, help="journal partition size")
+    parser.add_argument("--loop-every", type=int, default=1, help="saves between calls to FlashJournal::loop()")
+    args = parser.parse_args()
+
+    journal, fs = simulate(args)
+    perThousand = 1000.0 / args.updates
+    print("%d saves of a %d byte state, change records of %d bytes" % (args.updates, args.state_size, args.change_size))
+    print("LittleFS rewrite: %8.2f erases per 1000 saves" % (fs.erases * perThousand))
+    print("FlashJournal:     %8.2f erases per 1000 saves, %d records moved, %d to %d erases per sector" %
+          (sum(journal.sectorErases) * perThousand, journal.moved, min(journal.sectorErases),
+           max(journal.sectorErases)))
+
+
+if __name__ == "__main__":
+    main()
@@ -7,24 +7,30 @@ LedExampleService::LedExampleService(AsyncWebServer* server,
                                      ,BLEServer* bleServer
 #endif
                                      ) :
-    _httpEndpoint(LedExampleState::read,
-                  LedExampleState::update,
+    _httpEndpoint(LedExampleStateReader(),
+                  LedExampleStateUpdater(),
                   this,
                   server,
                   LED_EXAMPLE_ENDPOINT_PATH,
                   securityManager,
                   AuthenticationPredicates::IS_AUTHENTICATED),
-    _mqttPubSub(LedExampleState::haRead, LedExampleState::haUpdate, this, mqttClient),
-    _webSocket(LedExampleState::read,
-               LedExampleState::update,
+    _mqttPubSub(LedExampleStateHaReader(), LedExampleStateHaUpdater(), this, mqttClient),
+    _webSocket(LedExampleStateReader(),
+               LedExampleStateUpdater(),
                this,
                server,
                LED_EXAMPLE_SOCKET_PATH,
                securityManager,
                AuthenticationPredicates::IS_AUTHENTICATED),
+    _eventSource(LedExampleStateReader(),
+                 this,
+                 server,
+                 LED_EXAMPLE_EVENTS_PATH,
+                 securityManager,
+                 AuthenticationPredicates::IS_AUTHENTICATED),
     _mqttClient(mqttClient)
 #if FT_ENABLED(FT_BLE)
-    ,_blePubSub(LedExampleState::read, LedExampleState::update, this, bleServer),
+    ,_blePubSub(LedExampleStateReader(), LedExampleStateUpdater(), this, bleServer),
     _bleServer(bleServer),
     _bleService(nullptr),
     _bleCharacteristic(nullptr)
@@ -37,6 +43,14 @@ LedExampleService::LedExampleService(AsyncWebServer* server,
   _mqttName = SettingValue::format("led-example-#{unique_id}");
   _mqttUniqueId = SettingValue::format("led-#{unique_id}");
   
+  // WebSocket clients and BLE centrals send and receive only the fields which changed
+  _webSocket.setDeltaReader(LedExampleState::deltaRead);
+  _webSocket.setDeltaUpdater(LedExampleState::deltaUpdate);
+#if FT_ENABLED(FT_BLE)
+  _blePubSub.setDeltaReader(LedExampleState::deltaRead);
+  _blePubSub.setDeltaUpdater(LedExampleState::deltaUpdate);
+#endif
+
   // configure led to be output
   pinMode(LED_PIN, OUTPUT);
 
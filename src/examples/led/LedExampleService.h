@@ -4,6 +4,7 @@
 #include <HttpEndpoint.h>
 #include <MqttPubSub.h>
 #include <WebSocketTxRx.h>
+#include <EventSourceTx.h>
 #include <SettingValue.h>
 
 #if FT_ENABLED(FT_BLE)
@@ -31,6 +32,10 @@
 
 #define LED_EXAMPLE_ENDPOINT_PATH "/rest/ledExample"
 #define LED_EXAMPLE_SOCKET_PATH "/ws/ledExample"
+#define LED_EXAMPLE_EVENTS_PATH "/es/ledExample"
+
+// Field numbers for delta updates, see StatefulService
+#define LED_ON_FIELD STATE_FIELD(0)
 
 class LedExampleState {
  public:
@@ -49,6 +54,23 @@ class LedExampleState {
     return StateUpdateResult::UNCHANGED;
   }
 
+  // Writes only the requested fields, for delta messages and notifications
+  static void deltaRead(LedExampleState& settings, JsonObject& root, state_field_mask_t fields) {
+    if (fields & LED_ON_FIELD) {
+      root["led_on"] = settings.ledOn;
+    }
+  }
+
+  // Applies only the fields present, so clients may send partial updates, and reports the fields it changed
+  static StateUpdateResult deltaUpdate(JsonObject& root, LedExampleState& ledState, state_field_mask_t& changedFields) {
+    JsonVariant ledOn = root["led_on"];
+    if (ledOn.is<bool>() && ledState.ledOn != ledOn.as<bool>()) {
+      ledState.ledOn = ledOn.as<bool>();
+      changedFields |= LED_ON_FIELD;
+    }
+    return changedFields ? StateUpdateResult::CHANGED : StateUpdateResult::UNCHANGED;
+  }
+
   static void haRead(LedExampleState& settings, JsonObject& root) {
     root["state"] = settings.ledOn ? ON_STATE : OFF_STATE;
   }
@@ -71,6 +93,17 @@ class LedExampleState {
   }
 };
 
+typedef StaticJsonStateReader<LedExampleState, LedExampleState::read> LedExampleStateReader;
+typedef StaticJsonStateUpdater<LedExampleState, LedExampleState::update> LedExampleStateUpdater;
+typedef StaticJsonStateReader<LedExampleState, LedExampleState::haRead> LedExampleStateHaReader;
+typedef StaticJsonStateUpdater<LedExampleState, LedExampleState::haUpdate> LedExampleStateHaUpdater;
+
+// Both representations hold a single member whose key and value are constant strings, stored without copying
+template <>
+struct StateJsonCapacity<LedExampleState> {
+  static const size_t value = JSON_OBJECT_SIZE(1);
+};
+
 class LedExampleService : public StatefulService<LedExampleState> {
  public:
   LedExampleService(AsyncWebServer* server,
@@ -88,9 +121,10 @@ class LedExampleService : public StatefulService<LedExampleState> {
 #endif
 
  private:
-  HttpEndpoint<LedExampleState> _httpEndpoint;
-  MqttPubSub<LedExampleState> _mqttPubSub;
-  WebSocketTxRx<LedExampleState> _webSocket;
+  HttpEndpoint<LedExampleState, LedExampleStateReader, LedExampleStateUpdater> _httpEndpoint;
+  MqttPubSub<LedExampleState, LedExampleStateHaReader, LedExampleStateHaUpdater> _mqttPubSub;
+  WebSocketTxRx<LedExampleState, LedExampleStateReader, LedExampleStateUpdater> _webSocket;
+  EventSourceTx<LedExampleState, LedExampleStateReader> _eventSource;
   AsyncMqttClient* _mqttClient;
 
   // Inline MQTT configuration - single-layer pattern
@@ -99,7 +133,7 @@ class LedExampleService : public StatefulService<LedExampleState> {
   String _mqttUniqueId;
 
 #if FT_ENABLED(FT_BLE)
-  BlePubSub<LedExampleState> _blePubSub;
+  BlePubSub<LedExampleState, LedExampleStateReader, LedExampleStateUpdater> _blePubSub;
   BLEServer* _bleServer;
   BLEService* _bleService;
   BLECharacteristic* _bleCharacteristic;